@@ -4,7 +4,10 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
 #include <tchar.h>
+#endif
 #include <iostream>
 using namespace std;
 
@@ -15,6 +18,8 @@ using namespace cv;
 
 #include "Timer.h"
 #include "ConfigReader.h"
+#include "BatchRunner.h"
+#include "TiledSLIC.h"
 
 #include "segmentor.h"
 #include "SLICSegmentor.h"
@@ -38,6 +43,72 @@ int main(int argc, char* argv[])
 	Mat inImage;
 	string imgName;
 
+	// "-text" anywhere on the command line writes text results instead of binary label maps,
+	// "-boundaries" adds boundary masks and overlays to the batch output
+	bool textOutput = false, boundaryOutput = false;
+	vector<char*> args;
+	for (int i = 0; i < argc; i++)
+	{
+		if (string(argv[i]) == "-text")
+			textOutput = true;
+		else if (string(argv[i]) == "-boundaries")
+			boundaryOutput = true;
+		else
+			args.push_back(argv[i]);
+	}
+	argc = args.size();
+	argv = &args[0];
+
+	// out-of-core SLIC for images too large to load:
+	// -tiled <image.ppm> <labels.lbl> [step [strip rows [threads]]]
+	if (argc > 1 && string(argv[1]) == "-tiled")
+	{
+		if (argc < 4)
+		{
+			cout<<"Usage: "<<argv[0]<<" -tiled <image.ppm> <labels.lbl> [step [strip rows [threads]]]"<<endl;
+			return 1;
+		}
+		int step = argc > 4 ? atoi(argv[4]) : 15;
+		int stripRows = argc > 5 ? atoi(argv[5]) : 1024;
+		int threads = argc > 6 ? atoi(argv[6]) : 1;
+		int numLabels = TiledSLIC::Run(argv[2], argv[3], step, stripRows, threads);
+		if (numLabels < 0)
+			return 2;
+		cout<<"--"<<numLabels<<" superpixel labels written to "<<argv[3]<<endl;
+		return 0;
+	}
+
+	// headless batch mode:
+	// -batch <directory|pattern|list file> [output directory] [config file] [workers [decoders [writers]]]
+	if (argc > 1 && string(argv[1]) == "-batch")
+	{
+		if (argc < 3)
+		{
+			cout<<"Usage: "<<argv[0]<<" -batch <directory|pattern|list file> [output directory] [config file]"
+				<<" [workers [decoders [writers]]] [-text] [-boundaries]"<<endl;
+			return 1;
+		}
+		vector<string> files;
+		if (!BatchRunner::CollectImages(argv[2], files))
+			return 1;
+
+		vector<SegReq> segList;
+		ConfigReader re(argc > 4 ? string(argv[4]) : string("config.ini"));
+		re.GetSegRequire(segList);
+
+		BatchRunner runner(segList, argc > 3 ? string(argv[3]) : string("."));
+		if (argc > 5)
+		{
+			int workers = atoi(argv[5]);
+			int decoders = argc > 6 ? atoi(argv[6]) : (workers+3)/4;
+			int writers = argc > 7 ? atoi(argv[7]) : (workers+3)/4;
+			runner.SetThreads(decoders, workers, writers);
+		}
+		runner.SetTextOutput(textOutput);
+		runner.SetBoundaryOutput(boundaryOutput);
+		return runner.Run(files) == 0 ? 0 : 2;
+	}
+
 	if (argc > 1)
 	{
 		imgName = string(argv[1]);
@@ -47,7 +118,11 @@ int main(int argc, char* argv[])
 		cout<<endl;
 	}
 
-	inImage = imread(imgName);
+	// segmentors that accept any image get 16-bit, float and multispectral
+	// files with their own depth and channels, the others 8-bit BGR
+	Mat rawImage;
+	Segmentor::ReadImage(imgName, inImage, rawImage);
+	FeatureCache cache(inImage);	// shared by all segmentors below
 
 	vector<SegReq> segList;
 	ConfigReader re;
@@ -66,11 +141,21 @@ int main(int argc, char* argv[])
 			cout<<"--Error: Cannot create segmentor: "<<segName<<endl;
 			continue;
 		}
-		s->SetImage(inImage);
-		s->SetArgs(segArgs);
-		s->Run();
-		s->ShowResult();
-		s->SaveResult();
+		try
+		{
+			s->SetImage(s->AcceptsAnyImage() ? rawImage : inImage, &cache);
+			s->SetTextOutput(textOutput);
+			s->SetArgs(segArgs);
+			s->Run();
+			s->ShowResult();
+			s->SaveResult();
+		}
+		catch (const std::exception& e)	// e.g. an image the segmentor cannot take
+		{
+			cout<<"--Error: "<<segName<<" failed: "<<e.what()<<endl;
+			delete s;
+			continue;
+		}
 		t.Stop();	
 		waitKey(1);
 	}
@@ -0,0 +1,491 @@
+#include "BatchRunner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <thread>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+using namespace cv;
+
+#include "segmentor.h"
+#include "FeatureCache.h"
+
+BatchRunner::BatchRunner(const vector<SegReq>& _segList, const string& _outDir)
+{
+	m_SegList = _segList;
+	m_OutDir = _outDir.empty() ? string(".") : _outDir;
+	m_TextOutput = false;
+	m_BoundaryOutput = false;
+
+	int cores = thread::hardware_concurrency();
+	SetThreads((cores+3)/4, cores, (cores+3)/4);
+
+	m_Files = NULL;
+	m_Decoded = NULL;
+	m_Segmented = NULL;
+}
+
+BatchRunner::~BatchRunner(void)
+{
+}
+
+bool BatchRunner::CollectImages(const string& _source, vector<string>& _files)
+{
+	_files.clear();
+
+	if (IsDirectory(_source))
+	{
+		vector<string> names;
+		if (!ListDirectory(_source, names))
+			return false;
+		for (int i = 0; i < names.size(); i++)
+		{
+			if (IsImageFile(names[i]))
+				_files.push_back(JoinPath(_source, names[i]));
+		}
+	}
+	else if (_source.find_first_of("*?") != string::npos)
+	{
+		int sep = _source.find_last_of("/\\");
+		string dir = (sep == string::npos) ? string(".") : _source.substr(0, sep);
+		string pattern = _source.substr(sep + 1);
+		if (dir.find_first_of("*?") != string::npos)
+		{
+			cout<<"--Error: Wildcards are only supported in the file name: "<<_source<<endl;
+			return false;
+		}
+		vector<string> names;
+		if (!ListDirectory(dir, names))
+			return false;
+		for (int i = 0; i < names.size(); i++)
+		{
+			if (MatchWildcard(pattern.c_str(), names[i].c_str()))
+				_files.push_back(sep == string::npos ? names[i] : JoinPath(dir, names[i]));
+		}
+	}
+	else
+	{
+		ifstream listFile(_source.c_str(), ios::in);
+		if (!listFile)
+		{
+			cout<<"--Error: Cannot read image list: "<<_source<<endl;
+			return false;
+		}
+		string line;
+		while (getline(listFile, line))
+		{
+			int start = line.find_first_not_of(" \t\r\n");
+			if (start == string::npos || line[start] == '#')
+				continue;
+			int end = line.find_last_not_of(" \t\r\n");
+			_files.push_back(line.substr(start, end - start + 1));
+		}
+		return true;	// keep the order of the list
+	}
+
+	sort(_files.begin(), _files.end());
+	return true;
+}
+
+void BatchRunner::SetThreads(int _decoders, int _workers, int _writers)
+{
+	m_NumDecoders = _decoders < 1 ? 1 : _decoders;
+	m_NumWorkers = _workers < 1 ? 1 : _workers;
+	m_NumWriters = _writers < 1 ? 1 : _writers;
+}
+
+int BatchRunner::Run(const vector<string>& _files)
+{
+	// results are named after the file name without directory and extension,
+	// so two inputs with the same stem would overwrite each other's results;
+	// compared without case, as on Windows file systems
+	map<string, int> stems;
+	bool clash = false;
+	for (int i = 0; i < _files.size(); i++)
+	{
+		string stem = Stem(_files[i]);
+		for (int k = 0; k < stem.size(); k++)
+			stem[k] = tolower(stem[k]);
+		map<string, int>::iterator it = stems.find(stem);
+		if (it == stems.end())
+			stems[stem] = i;
+		else
+		{
+			cout<<"--Error: "<<_files[it->second]<<" and "<<_files[i]<<" would write the same results"<<endl;
+			clash = true;
+		}
+	}
+	if (clash)
+		return _files.size();
+
+	MakeDirectory(m_OutDir);
+
+	string timingName = JoinPath(m_OutDir, "timing.csv");
+	m_Timing.open(timingName.c_str(), ios::out);
+	if (!m_Timing)
+	{
+		cout<<"--Error: Cannot write timing summary: "<<timingName<<endl;
+		return _files.size();
+	}
+	m_Timing<<"image,width,height,stage,result,seconds"<<endl;
+
+	// find the segmentors that can run without a window
+	m_Active.clear();
+	m_AnyImage = m_NeedsBGR = false;
+	bool streaming = false;
+	for (int i = 0; i < m_SegList.size(); i++)
+	{
+		string segName = m_SegList[i].first;
+		Segmentor* s = Segmentor::Create(segName+string("Segmentor"));
+		if (s == NULL)
+			cout<<"--Error: Cannot create segmentor: "<<segName<<endl;
+		else if (s->IsInteractive())
+			cout<<"--Skipping interactive segmentor: "<<segName<<endl;
+		else
+		{
+			m_Active.push_back(i);
+			s->SetArgs(m_SegList[i].second);
+			if (s->IsStreaming())
+				streaming = true;
+			if (s->AcceptsAnyImage())
+				m_AnyImage = true;
+			else
+				m_NeedsBGR = true;
+		}
+		delete s;
+	}
+
+	// streamed frames must reach one segmentor instance in order: a single
+	// decoder fills the queue in file order and a single worker takes them
+	int numDecoders = m_NumDecoders, numWorkers = m_NumWorkers;
+	if (streaming && (numDecoders > 1 || numWorkers > 1))
+	{
+		cout<<"--Stream mode: segmenting the frames in order with one decoder and one worker"<<endl;
+		numDecoders = numWorkers = 1;
+	}
+
+	cout<<"=====Batch: "<<_files.size()<<" image(s), "<<numDecoders<<" decoder(s), "
+		<<numWorkers<<" worker(s), "<<m_NumWriters<<" writer(s)"<<endl;
+
+	// a few images in flight per worker keep every stage busy
+	BoundedQueue<DecodedImage> decoded(2*numWorkers);
+	BoundedQueue<SegmentedImage> segmented(2*numWorkers);
+	m_Files = &_files;
+	m_NextFile = 0;
+	m_Failed = 0;
+	m_Decoded = &decoded;
+	m_Segmented = &segmented;
+
+	vector<thread> decoders, workers, writers;
+	for (int i = 0; i < numDecoders; i++)
+		decoders.push_back(thread(&BatchRunner::DecodeLoop, this));
+	for (int i = 0; i < numWorkers; i++)
+		workers.push_back(thread(&BatchRunner::SegmentLoop, this));
+	for (int i = 0; i < m_NumWriters; i++)
+		writers.push_back(thread(&BatchRunner::WriteLoop, this));
+
+	// each queue is closed once all of its producers are done
+	for (int i = 0; i < decoders.size(); i++)
+		decoders[i].join();
+	decoded.Close();
+	for (int i = 0; i < workers.size(); i++)
+		workers[i].join();
+	segmented.Close();
+	for (int i = 0; i < writers.size(); i++)
+		writers[i].join();
+
+	m_Decoded = NULL;
+	m_Segmented = NULL;
+	m_Files = NULL;
+	m_Timing.close();
+
+	int failed = m_Failed;
+	cout<<"=====Batch done: "<<_files.size()-failed<<" image(s) processed, "
+		<<failed<<" failed, timing in "<<timingName<<endl;
+	return failed;
+}
+
+void BatchRunner::DecodeLoop()
+{
+	double freq = getTickFrequency();
+	int n = m_Files->size();
+	for (int index = m_NextFile++; index < n; index = m_NextFile++)
+	{
+		const string& file = (*m_Files)[index];
+		int64 start = getTickCount();
+
+		DecodedImage item;
+		item.index = index;
+		// one decode unless the file is 16-bit, float or multispectral and
+		// both kinds of segmentor are active
+		Segmentor::ReadImage(file, item.image, item.raw, m_NeedsBGR, m_AnyImage);
+		item.seconds = (getTickCount() - start) / freq;
+		if (item.image.empty() && item.raw.empty())
+		{
+			cout<<"--Error: Cannot read image: "<<file<<endl;
+			m_Failed++;
+			continue;
+		}
+		if (!m_Decoded->Push(item))
+			break;
+	}
+}
+
+void BatchRunner::SegmentLoop()
+{
+	// one instance of every segmentor per worker
+	vector<Segmentor*> segs(m_Active.size());
+	for (int k = 0; k < m_Active.size(); k++)
+	{
+		const SegReq& req = m_SegList[m_Active[k]];
+		segs[k] = Segmentor::Create(req.first+string("Segmentor"));
+		segs[k]->SetArgs(req.second);
+	}
+
+	double freq = getTickFrequency();
+	DecodedImage in;
+	while (m_Decoded->Pop(in))
+	{
+		const string& file = (*m_Files)[in.index];
+		string stem = Stem(file);
+		FeatureCache cache(in.image);
+		const Mat& any = in.raw.empty() ? in.image : in.raw;
+
+		SegmentedImage out;
+		out.index = in.index;
+		out.width = any.cols;
+		out.height = any.rows;
+		out.seconds = in.seconds;
+		if (m_BoundaryOutput)
+			out.image = in.image.empty() ? in.raw : in.image;
+		stringstream timing;
+		TimingLine(timing, file, out.width, out.height, "decode", "", in.seconds);
+
+		bool ok = true;
+		for (int k = 0; k < segs.size(); k++)
+		{
+			Segmentor* s = segs[k];
+			int64 start = getTickCount();
+			try
+			{
+				s->SetImage(s->AcceptsAnyImage() ? any : in.image, &cache);
+				s->Run();
+			}
+			catch (const std::exception& e)	// cv::Exception, bad_alloc, ...
+			{
+				cout<<"--Error: "<<m_SegList[m_Active[k]].first<<" failed on "<<file<<": "<<e.what()<<endl;
+				ok = false;
+				continue;
+			}
+			catch (...)
+			{
+				cout<<"--Error: "<<m_SegList[m_Active[k]].first<<" failed on "<<file<<endl;
+				ok = false;
+				continue;
+			}
+			double seconds = (getTickCount() - start) / freq;
+			out.seconds += seconds;
+			TimingLine(timing, file, out.width, out.height, m_SegList[m_Active[k]].first, s->GetResultName(), seconds);
+
+			// hand the labels over to the writer; the next SetImage allocates new ones
+			out.fileNames.push_back(Segmentor::ResultFileName(JoinPath(m_OutDir, stem + "_" + s->GetResultName()), m_TextOutput));
+			out.labels.push_back(s->m_Result);
+			s->m_Result.release();
+		}
+		out.failed = !ok;
+		if (!ok)
+			m_Failed++;
+
+		out.timing = timing.str();
+		if (!m_Segmented->Push(out))
+			break;
+	}
+
+	for (int k = 0; k < segs.size(); k++)
+		delete segs[k];
+}
+
+void BatchRunner::WriteLoop()
+{
+	double freq = getTickFrequency();
+	SegmentedImage in;
+	while (m_Segmented->Pop(in))
+	{
+		const string& file = (*m_Files)[in.index];
+		int64 start = getTickCount();
+		try
+		{
+			for (int k = 0; k < in.labels.size(); k++)
+			{
+				Segmentor::WriteResult(in.labels[k], in.fileNames[k], m_TextOutput);
+				if (m_BoundaryOutput)
+					WriteBoundaries(in.image, in.labels[k], in.fileNames[k]);
+			}
+		}
+		catch (const std::exception& e)
+		{
+			cout<<"--Error: Cannot write results of "<<file<<": "<<e.what()<<endl;
+			if (!in.failed)	// each image counts once
+				m_Failed++;
+			continue;
+		}
+		double seconds = (getTickCount() - start) / freq;
+
+		stringstream timing;
+		timing<<in.timing;
+		TimingLine(timing, file, in.width, in.height, "write", "", seconds);
+		TimingLine(timing, file, in.width, in.height, "total", "", in.seconds + seconds);
+
+		lock_guard<mutex> lock(m_TimingMutex);
+		m_Timing<<timing.str();
+		cout<<"--"<<file<<": "<<in.seconds + seconds<<" s"<<endl;
+	}
+}
+
+void BatchRunner::WriteBoundaries(const Mat& _img, const Mat& _labels, const string& _resultFile)
+{
+	string base = _resultFile.substr(0, _resultFile.find_last_of('.'));
+	Mat mask, overlay;
+	Segmentor::BoundaryMask(_labels, mask);
+	_img.copyTo(overlay);
+	overlay.setTo(Scalar(0, 0, 255), mask);
+	imwrite(base + "_boundary.png", mask);
+	imwrite(base + "_overlay.png", overlay);
+}
+
+void BatchRunner::TimingLine(stringstream& _ss, const string& _file, int _width, int _height,
+	const string& _stage, const string& _result, double _seconds)
+{
+	_ss<<_file<<","<<_width<<","<<_height<<","<<_stage<<","<<_result<<","<<_seconds<<endl;
+}
+
+bool BatchRunner::IsDirectory(const string& _path)
+{
+	struct stat st;
+	if (stat(_path.c_str(), &st) != 0)
+		return false;
+	return (st.st_mode & S_IFDIR) != 0;
+}
+
+bool BatchRunner::IsImageFile(const string& _name)
+{
+	static const char* exts[] = {"bmp", "dib", "jpg", "jpeg", "jpe", "png", "tif", "tiff",
+		"pbm", "pgm", "ppm", "ras", "sr", "jp2", "webp"};
+
+	int dot = _name.find_last_of('.');
+	if (dot == string::npos)
+		return false;
+	string ext = _name.substr(dot + 1);
+	for (int i = 0; i < ext.size(); i++)
+		ext[i] = tolower(ext[i]);
+	for (int i = 0; i < sizeof(exts)/sizeof(exts[0]); i++)
+	{
+		if (ext == exts[i])
+			return true;
+	}
+	return false;
+}
+
+bool BatchRunner::ListDirectory(const string& _dir, vector<string>& _names)
+{
+	_names.clear();
+#ifdef _WIN32
+	_finddata_t data;
+	intptr_t handle = _findfirst(JoinPath(_dir, "*").c_str(), &data);
+	if (handle == -1)
+	{
+		cout<<"--Error: Cannot open directory: "<<_dir<<endl;
+		return false;
+	}
+	do
+	{
+		if (!(data.attrib & _A_SUBDIR))
+			_names.push_back(data.name);
+	} while (_findnext(handle, &data) == 0);
+	_findclose(handle);
+#else
+	DIR* dir = opendir(_dir.c_str());
+	if (dir == NULL)
+	{
+		cout<<"--Error: Cannot open directory: "<<_dir<<endl;
+		return false;
+	}
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		string name(entry->d_name);
+		if (!IsDirectory(JoinPath(_dir, name)))
+			_names.push_back(name);
+	}
+	closedir(dir);
+#endif
+	return true;
+}
+
+bool BatchRunner::MatchWildcard(const char* _pat, const char* _str)
+{
+	// iterative matcher: on mismatch, let the last '*' absorb one more character
+	const char* star = NULL;
+	const char* resume = NULL;
+	while (*_str)
+	{
+		if (*_pat == '*')
+		{
+			star = _pat++;
+			resume = _str;
+		}
+		else if (*_pat == '?' || *_pat == *_str)
+		{
+			_pat++;
+			_str++;
+		}
+		else if (star)
+		{
+			_pat = star + 1;
+			_str = ++resume;
+		}
+		else
+			return false;
+	}
+	while (*_pat == '*')
+		_pat++;
+	return *_pat == 0;
+}
+
+string BatchRunner::JoinPath(const string& _dir, const string& _name)
+{
+	if (_dir.empty())
+		return _name;
+	char last = _dir[_dir.size() - 1];
+	if (last == '/' || last == '\\')
+		return _dir + _name;
+	return _dir + "/" + _name;
+}
+
+string BatchRunner::Stem(const string& _path)
+{
+	int sep = _path.find_last_of("/\\");
+	string name = (sep == string::npos) ? _path : _path.substr(sep + 1);
+	int dot = name.find_last_of('.');
+	return (dot == string::npos) ? name : name.substr(0, dot);
+}
+
+void BatchRunner::MakeDirectory(const string& _dir)
+{
+	if (IsDirectory(_dir))
+		return;
+#ifdef _WIN32
+	_mkdir(_dir.c_str());
+#else
+	mkdir(_dir.c_str(), 0755);
+#endif
+}
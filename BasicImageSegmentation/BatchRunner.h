@@ -0,0 +1,110 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+using namespace std;
+
+#include "opencv2/core/core.hpp"
+using namespace cv;
+
+#include "ConfigReader.h"
+#include "BoundedQueue.h"
+
+// Headless batch mode: runs every SegReq on every input image without
+// opening a window. For an image "dir/name.jpg" each result is saved as
+// "<outDir>/name_<result name>", and one line per (image, stage) is
+// appended to "<outDir>/timing.csv". Run refuses inputs whose names only
+// differ in directory, extension or case. Interactive segmentors (GrabCut,
+// OneCut) are skipped.
+//
+// The images flow through three thread pools connected by bounded queues:
+// decoders (imread) -> segmentation workers -> writers (WriteResult). Each
+// worker owns one instance of every segmentor, created once through
+// Segmentor::Create and reused for all the images it processes.
+class BatchRunner
+{
+public:
+	BatchRunner(const vector<SegReq>& _segList, const string& _outDir);
+	~BatchRunner(void);
+
+	// Pool sizes; values < 1 are clamped to 1. Defaults: one worker per core,
+	// one decoder and one writer per four workers. Run uses one decoder and
+	// one worker when a segmentor streams (Segmentor::IsStreaming).
+	void SetThreads(int _decoders, int _workers, int _writers);
+	// write text results instead of binary label maps
+	void SetTextOutput(bool _text) { m_TextOutput = _text; }
+	// also save "name_<result name>_boundary.png" (CV_8UC1 mask) and
+	// "name_<result name>_overlay.png" (input with red boundaries)
+	void SetBoundaryOutput(bool _boundaries) { m_BoundaryOutput = _boundaries; }
+
+	// Expands _source into a sorted list of image files. _source is either a
+	// directory (all images in it), a pattern with '*' or '?' in the file
+	// name part, e.g. "data/*.jpg", or a list file with one path per line
+	// ('#' starts a comment). Returns false if _source cannot be read.
+	static bool CollectImages(const string& _source, vector<string>& _files);
+
+	// Returns the number of images that could not be processed.
+	int Run(const vector<string>& _files);
+
+private:
+	struct DecodedImage
+	{
+		int index;
+		Mat image;		// 8-bit BGR, empty if no active segmentor needs it
+		Mat raw;		// with its own depth and channels, see Segmentor::ReadImage
+		double seconds;
+	};
+	struct SegmentedImage
+	{
+		int index;
+		int width, height;
+		Mat image;					// kept for the overlays, empty otherwise
+		vector<string> fileNames;	// one result per active segmentor
+		vector<Mat> labels;
+		string timing;				// csv lines of the decode and segment stages
+		double seconds;
+		bool failed;				// a segmentor threw; already counted in m_Failed
+	};
+
+	void DecodeLoop();
+	void SegmentLoop();
+	void WriteLoop();
+
+	static void WriteBoundaries(const Mat& _img, const Mat& _labels, const string& _resultFile);
+
+	static void TimingLine(stringstream& _ss, const string& _file, int _width, int _height,
+		const string& _stage, const string& _result, double _seconds);
+
+	static bool IsDirectory(const string& _path);
+	static bool IsImageFile(const string& _name);
+	static bool ListDirectory(const string& _dir, vector<string>& _names);
+	static bool MatchWildcard(const char* _pat, const char* _str);
+	static string JoinPath(const string& _dir, const string& _name);
+	static string Stem(const string& _path);
+	static void MakeDirectory(const string& _dir);
+
+	vector<SegReq> m_SegList;
+	vector<int> m_Active;		// indices of the SegReqs that can run headless
+	bool m_AnyImage;			// an active segmentor accepts any image
+	bool m_NeedsBGR;			// an active segmentor needs 8-bit BGR
+	string m_OutDir;
+	bool m_TextOutput;
+	bool m_BoundaryOutput;
+
+	int m_NumDecoders;
+	int m_NumWorkers;
+	int m_NumWriters;
+
+	// state of the current Run
+	const vector<string>* m_Files;
+	atomic<int> m_NextFile;
+	atomic<int> m_Failed;
+	BoundedQueue<DecodedImage>* m_Decoded;
+	BoundedQueue<SegmentedImage>* m_Segmented;
+	ofstream m_Timing;
+	mutex m_TimingMutex;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+// Fixed-capacity FIFO connecting the stages of the batch pipeline. Push
+// blocks while the queue is full, which throttles a fast producer to the
+// speed of its consumers; Pop blocks while it is empty. After Close, Push
+// fails and Pop drains the remaining items, then fails.
+template<typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(int _capacity) : m_Capacity(_capacity < 1 ? 1 : _capacity), m_Closed(false) {}
+
+	bool Push(const T& _item)
+	{
+		unique_lock<mutex> lock(m_Mutex);
+		while (!m_Closed && m_Items.size() >= m_Capacity)
+			m_NotFull.wait(lock);
+		if (m_Closed)
+			return false;
+		m_Items.push_back(_item);
+		m_NotEmpty.notify_one();
+		return true;
+	}
+
+	bool Pop(T& _item)
+	{
+		unique_lock<mutex> lock(m_Mutex);
+		while (!m_Closed && m_Items.empty())
+			m_NotEmpty.wait(lock);
+		if (m_Items.empty())
+			return false;
+		_item = m_Items.front();
+		m_Items.pop_front();
+		m_NotFull.notify_one();
+		return true;
+	}
+
+	void Close()
+	{
+		lock_guard<mutex> lock(m_Mutex);
+		m_Closed = true;
+		m_NotFull.notify_all();
+		m_NotEmpty.notify_all();
+	}
+
+private:
+	BoundedQueue(const BoundedQueue&);
+	BoundedQueue& operator=(const BoundedQueue&);
+
+	deque<T> m_Items;
+	size_t m_Capacity;
+	bool m_Closed;
+	mutex m_Mutex;
+	condition_variable m_NotFull;
+	condition_variable m_NotEmpty;
+};
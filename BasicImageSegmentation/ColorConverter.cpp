@@ -0,0 +1,336 @@
+#include "ColorConverter.h"
+
+#include <cmath>
+#include <mutex>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define COLORCONVERTER_SSE2
+#endif
+
+// CIE constants
+static const double LAB_EPSILON = 0.008856;
+static const double LAB_KAPPA = 903.3;
+
+// D65 reference white
+static const double WHITE_X = 0.950456;
+static const double WHITE_Y = 1.0;
+static const double WHITE_Z = 1.088754;
+static const double WHITE_U = 4*WHITE_X / (WHITE_X + 15*WHITE_Y + 3*WHITE_Z);
+static const double WHITE_V = 9*WHITE_Y / (WHITE_X + 15*WHITE_Y + 3*WHITE_Z);
+
+// the cube root table covers [0, CBRT_MAX]; XYZ/white stays below 1.0
+static const double CBRT_MAX = 1.25;
+
+double ColorConverter::s_Gamma[256];
+double ColorConverter::s_Cbrt[CBRT_TABLE_SIZE+2];
+
+static std::once_flag s_TablesBuilt;
+
+void ColorConverter::BuildTables()
+{
+	for (int i = 0; i < 256; i++)
+	{
+		double c = i/255.0;
+		s_Gamma[i] = (c <= 0.04045) ? c/12.92 : pow((c+0.055)/1.055, 2.4);
+	}
+	for (int i = 0; i < CBRT_TABLE_SIZE+2; i++)
+	{
+		s_Cbrt[i] = pow(i*CBRT_MAX/CBRT_TABLE_SIZE, 1.0/3.0);
+	}
+}
+
+void ColorConverter::InitTables()
+{
+	std::call_once(s_TablesBuilt, BuildTables);
+}
+
+inline void ColorConverter::RGB2XYZ(int r, int g, int b, double& X, double& Y, double& Z)
+{
+	double rl = s_Gamma[r];
+	double gl = s_Gamma[g];
+	double bl = s_Gamma[b];
+
+	X = rl*0.4124564 + gl*0.3575761 + bl*0.1804375;
+	Y = rl*0.2126729 + gl*0.7151522 + bl*0.0721750;
+	Z = rl*0.0193339 + gl*0.1191920 + bl*0.9503041;
+}
+
+// t^(1/3) for t > LAB_EPSILON: linear interpolation in the table, then one
+// Halley step, which cubes the relative error of the interpolation.
+inline double ColorConverter::CubeRoot(double t)
+{
+	double pos = t*(CBRT_TABLE_SIZE/CBRT_MAX);
+	int i = (int)pos;
+	if (i >= CBRT_TABLE_SIZE)
+		return pow(t, 1.0/3.0);
+	double y = s_Cbrt[i] + (pos-i)*(s_Cbrt[i+1]-s_Cbrt[i]);
+	double y3 = y*y*y;
+	return y*(y3 + 2.0*t)/(2.0*y3 + t);
+}
+
+inline double ColorConverter::LabF(double t)
+{
+	return (t > LAB_EPSILON) ? CubeRoot(t) : (LAB_KAPPA*t + 16.0)/116.0;
+}
+
+inline void ColorConverter::LabPixel(int r, int g, int b, double& lval, double& aval, double& bval)
+{
+	double X, Y, Z;
+	RGB2XYZ(r, g, b, X, Y, Z);
+
+	double fx = LabF(X*(1.0/WHITE_X));
+	double fy = LabF(Y*(1.0/WHITE_Y));
+	double fz = LabF(Z*(1.0/WHITE_Z));
+
+	lval = 116.0*fy - 16.0;
+	aval = 500.0*(fx - fy);
+	bval = 200.0*(fy - fz);
+}
+
+inline void ColorConverter::LuvPixel(int r, int g, int b, double& lval, double& uval, double& vval)
+{
+	double X, Y, Z;
+	RGB2XYZ(r, g, b, X, Y, Z);
+
+	double yr = Y*(1.0/WHITE_Y);
+	lval = (yr > LAB_EPSILON) ? 116.0*CubeRoot(yr) - 16.0 : LAB_KAPPA*yr;
+
+	double denom = X + 15*Y + 3*Z;
+	double up = 4.0, vp = 9.0/15.0;
+	if (denom != 0)
+	{
+		up = 4*X / denom;
+		vp = 9*Y / denom;
+	}
+	uval = 13*lval*(up - WHITE_U);
+	vval = 13*lval*(vp - WHITE_V);
+}
+
+#ifdef COLORCONVERTER_SSE2
+// LabF() on two values (size: entries of the cube root table), with the same operations as the scalar code in
+// each lane, so the results are bit-identical. Returns false if a value is
+// beyond the cube root table; the caller then takes the scalar path.
+static inline bool LabF2(__m128d t, const double* cbrt, int size, __m128d& f)
+{
+	const __m128d pos = _mm_mul_pd(t, _mm_set1_pd(size/CBRT_MAX));
+	if (_mm_movemask_pd(_mm_cmpge_pd(pos, _mm_set1_pd(size))))
+		return false;
+	const __m128i idx = _mm_cvttpd_epi32(pos);
+	const int i0 = _mm_cvtsi128_si32(idx);
+	const int i1 = _mm_cvtsi128_si32(_mm_srli_si128(idx, 4));
+	const __m128d lo = _mm_set_pd(cbrt[i1], cbrt[i0]);
+	const __m128d hi = _mm_set_pd(cbrt[i1+1], cbrt[i0+1]);
+	const __m128d cube = _mm_cmpgt_pd(t, _mm_set1_pd(LAB_EPSILON));
+	const int cubemask = _mm_movemask_pd(cube);
+	__m128d root = _mm_setzero_pd(), lin = _mm_setzero_pd();
+	if (cubemask)
+	{
+		const __m128d y = _mm_add_pd(lo, _mm_mul_pd(_mm_sub_pd(pos, _mm_cvtepi32_pd(idx)), _mm_sub_pd(hi, lo)));
+		const __m128d y3 = _mm_mul_pd(_mm_mul_pd(y, y), y);
+		root = _mm_div_pd(_mm_mul_pd(y, _mm_add_pd(y3, _mm_mul_pd(_mm_set1_pd(2.0), t))),
+			_mm_add_pd(_mm_mul_pd(_mm_set1_pd(2.0), y3), t));
+	}
+	if (cubemask != 3)	// dark values, rare
+		lin = _mm_div_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(LAB_KAPPA), t), _mm_set1_pd(16.0)), _mm_set1_pd(116.0));
+	f = _mm_or_pd(_mm_and_pd(cube, root), _mm_andnot_pd(cube, lin));
+	return true;
+}
+
+// LabPixel() on two pixels
+bool ColorConverter::LabPixel2(const int* r, const int* g, const int* b, double* lval, double* aval, double* bval)
+{
+	const __m128d rl = _mm_set_pd(s_Gamma[r[1]], s_Gamma[r[0]]);
+	const __m128d gl = _mm_set_pd(s_Gamma[g[1]], s_Gamma[g[0]]);
+	const __m128d bl = _mm_set_pd(s_Gamma[b[1]], s_Gamma[b[0]]);
+
+	const __m128d X = _mm_add_pd(_mm_add_pd(_mm_mul_pd(rl, _mm_set1_pd(0.4124564)), _mm_mul_pd(gl, _mm_set1_pd(0.3575761))), _mm_mul_pd(bl, _mm_set1_pd(0.1804375)));
+	const __m128d Y = _mm_add_pd(_mm_add_pd(_mm_mul_pd(rl, _mm_set1_pd(0.2126729)), _mm_mul_pd(gl, _mm_set1_pd(0.7151522))), _mm_mul_pd(bl, _mm_set1_pd(0.0721750)));
+	const __m128d Z = _mm_add_pd(_mm_add_pd(_mm_mul_pd(rl, _mm_set1_pd(0.0193339)), _mm_mul_pd(gl, _mm_set1_pd(0.1191920))), _mm_mul_pd(bl, _mm_set1_pd(0.9503041)));
+
+	__m128d fx, fy, fz;
+	if (!LabF2(_mm_mul_pd(X, _mm_set1_pd(1.0/WHITE_X)), s_Cbrt, CBRT_TABLE_SIZE, fx) ||
+		!LabF2(_mm_mul_pd(Y, _mm_set1_pd(1.0/WHITE_Y)), s_Cbrt, CBRT_TABLE_SIZE, fy) ||
+		!LabF2(_mm_mul_pd(Z, _mm_set1_pd(1.0/WHITE_Z)), s_Cbrt, CBRT_TABLE_SIZE, fz))
+		return false;
+
+	_mm_storeu_pd(lval, _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(116.0), fy), _mm_set1_pd(16.0)));
+	_mm_storeu_pd(aval, _mm_mul_pd(_mm_set1_pd(500.0), _mm_sub_pd(fx, fy)));
+	_mm_storeu_pd(bval, _mm_mul_pd(_mm_set1_pd(200.0), _mm_sub_pd(fy, fz)));
+	return true;
+}
+#endif
+
+void ColorConverter::RGB2Lab(int r, int g, int b, double& lval, double& aval, double& bval)
+{
+	InitTables();
+	LabPixel(r, g, b, lval, aval, bval);
+}
+
+void ColorConverter::RGB2Luv(int r, int g, int b, double& lval, double& uval, double& vval)
+{
+	InitTables();
+	LuvPixel(r, g, b, lval, uval, vval);
+}
+
+void ColorConverter::RGB2YCbCr(int r, int g, int b, double& yval, double& cbval, double& crval)
+{
+	// ITU-R BT.601, full range
+	yval  =         0.299*r    + 0.587*g    + 0.114*b;
+	cbval = 128.0 - 0.168736*r - 0.331264*g + 0.5*b;
+	crval = 128.0 + 0.5*r      - 0.418688*g - 0.081312*b;
+}
+
+// H and S in [0,1], V = max(r,g,b)/256 so that V*nr_bins never reaches nr_bins.
+void ColorConverter::RGB2HSV(int r, int g, int b, float& hval, float& sval, float& vval)
+{
+	float r_ = r / 256.0;
+	float g_ = g / 256.0;
+	float b_ = b / 256.0;
+
+	float min_rgb = r_ < g_ ? (r_ < b_ ? r_ : b_) : (g_ < b_ ? g_ : b_);
+	float max_rgb = r_ > g_ ? (r_ > b_ ? r_ : b_) : (g_ > b_ ? g_ : b_);
+	float V = max_rgb;
+	float H = 0.0;
+	float S = 0.0;
+
+	float delta = max_rgb - min_rgb;
+
+	if ((delta > 0.0) && (max_rgb > 0.0))
+	{
+		S = delta / max_rgb;
+		if (max_rgb == r_)
+			H = (g_ - b_) / delta;
+		else if (max_rgb == g_)
+			H = 2 + (b_ - r_) / delta;
+		else
+			H = 4 + (r_ - g_) / delta;
+	}
+
+	H /= 6;
+	if (H < 0.0) H += 1.0;
+
+	hval = H;
+	sval = S;
+	vval = V;
+}
+
+void ColorConverter::Luv2RGB(const float* luv, unsigned char* rgb)
+{
+	int c[3] = {0, 0, 0};
+
+	if (luv[0] >= 0.1)
+	{
+		double Y;
+		if (luv[0] < 8.0)
+			Y = WHITE_Y * luv[0] / LAB_KAPPA;
+		else
+		{
+			Y = (luv[0] + 16.0) / 116.0;
+			Y *= WHITE_Y * Y * Y;
+		}
+		double up = luv[1] / (13 * luv[0]) + WHITE_U;
+		double vp = luv[2] / (13 * luv[0]) + WHITE_V;
+		double X = 9 * up * Y / (4 * vp);
+		double Z = (12 - 3 * up - 20 * vp) * Y / (4 * vp);
+
+		double lin[3];
+		lin[0] =  3.2404542*X - 1.5371385*Y - 0.4985314*Z;
+		lin[1] = -0.9692660*X + 1.8760108*Y + 0.0415560*Z;
+		lin[2] =  0.0556434*X - 0.2040259*Y + 1.0572252*Z;
+		for (int k = 0; k < 3; k++)
+		{
+			double v = lin[k] <= 0.0031308 ? 12.92*lin[k] : 1.055*pow(lin[k], 1.0/2.4) - 0.055;
+			c[k] = (int)(v*255.0 + 0.5);
+			if (c[k] < 0) c[k] = 0;
+			if (c[k] > 255) c[k] = 255;
+		}
+	}
+
+	rgb[0] = c[0];
+	rgb[1] = c[1];
+	rgb[2] = c[2];
+}
+
+void ColorConverter::ARGB2Lab(const unsigned int* ubuff, int n, double* lvec, double* avec, double* bvec)
+{
+	InitTables();
+
+	int i = 0;
+#ifdef COLORCONVERTER_SSE2
+	for ( ; i+2 <= n; i += 2)
+	{
+		int r[2], g[2], b[2];
+		for (int k = 0; k < 2; k++)
+		{
+			r[k] = (ubuff[i+k] >> 16) & 0xFF;
+			g[k] = (ubuff[i+k] >>  8) & 0xFF;
+			b[k] = (ubuff[i+k]      ) & 0xFF;
+		}
+		if (!LabPixel2(r, g, b, lvec+i, avec+i, bvec+i))
+		{
+			LabPixel(r[0], g[0], b[0], lvec[i], avec[i], bvec[i]);
+			LabPixel(r[1], g[1], b[1], lvec[i+1], avec[i+1], bvec[i+1]);
+		}
+	}
+#endif
+	for ( ; i < n; i++)
+	{
+		int r = (ubuff[i] >> 16) & 0xFF;
+		int g = (ubuff[i] >>  8) & 0xFF;
+		int b = (ubuff[i]      ) & 0xFF;
+
+		LabPixel(r, g, b, lvec[i], avec[i], bvec[i]);
+	}
+}
+
+void ColorConverter::ARGB2HSV(const unsigned int* ubuff, int n, float* hvec, float* svec, float* vvec)
+{
+	for (int i = 0; i < n; i++)
+	{
+		int r = (ubuff[i] >> 16) & 0xFF;
+		int g = (ubuff[i] >>  8) & 0xFF;
+		int b = (ubuff[i]      ) & 0xFF;
+		RGB2HSV(r, g, b, hvec[i], svec[i], vvec[i]);
+	}
+}
+
+void ColorConverter::BGR2Lab(const unsigned char* bgr, int n, float* lab)
+{
+	InitTables();
+
+	for (int i = 0; i < n; i++, bgr += 3, lab += 3)
+	{
+		double l, a, b;
+		LabPixel(bgr[2], bgr[1], bgr[0], l, a, b);
+		lab[0] = (float)l;
+		lab[1] = (float)a;
+		lab[2] = (float)b;
+	}
+}
+
+void ColorConverter::BGR2YCbCr(const unsigned char* bgr, int n, float* ycc)
+{
+	for (int i = 0; i < n; i++, bgr += 3, ycc += 3)
+	{
+		double y, cb, cr;
+		RGB2YCbCr(bgr[2], bgr[1], bgr[0], y, cb, cr);
+		ycc[0] = (float)y;
+		ycc[1] = (float)cb;
+		ycc[2] = (float)cr;
+	}
+}
+
+void ColorConverter::RGB2Luv(const unsigned char* rgb, int n, float* luv)
+{
+	InitTables();
+
+	for (int i = 0; i < n; i++, rgb += 3, luv += 3)
+	{
+		double l, u, v;
+		LuvPixel(rgb[0], rgb[1], rgb[2], l, u, v);
+		luv[0] = (float)l;
+		luv[1] = (float)u;
+		luv[2] = (float)v;
+	}
+}
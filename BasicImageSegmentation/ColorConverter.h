@@ -0,0 +1,58 @@
+#pragma once
+
+// Colour conversions shared by all segmentors.
+//
+// The input is 8-bit sRGB (D65). Lab and Luv are computed through the sRGB
+// gamma, the standard sRGB->XYZ matrix and the CIE formulas. Instead of the
+// pow() calls of the reference formulas, the gamma is read from a 256-entry
+// table and the cube root from an interpolated table refined by one Halley
+// step, so the results agree with the exact formulas to about 1e-8.
+// ARGB2Lab converts two pixels at a time with SSE2, bit-identical to the
+// scalar path.
+// The tables are built on first use and are safe to share between threads.
+class ColorConverter
+{
+public:
+	// single pixel
+	static void RGB2Lab(int r, int g, int b, double& lval, double& aval, double& bval);
+	static void RGB2Luv(int r, int g, int b, double& lval, double& uval, double& vval);
+	static void RGB2YCbCr(int r, int g, int b, double& yval, double& cbval, double& crval);
+	static void RGB2HSV(int r, int g, int b, float& hval, float& sval, float& vval);
+	static void Luv2RGB(const float* luv, unsigned char* rgb);
+
+	// joint histogram bin of an RGB2HSV() triple, nr_bins bins per channel
+	static int HSV2Bin(float h, float s, float v, int nr_bins)
+	{
+		int hbin = int(h * nr_bins);
+		int sbin = int(s * nr_bins);
+		int vbin = int(v * nr_bins);
+		if (sbin == nr_bins) --sbin; // S can be equal to 1.0
+
+		return hbin + nr_bins*(sbin + nr_bins*vbin);
+	}
+
+	// packed 0x00RRGGBB pixels to planar output
+	static void ARGB2Lab(const unsigned int* ubuff, int n, double* lvec, double* avec, double* bvec);
+	static void ARGB2HSV(const unsigned int* ubuff, int n, float* hvec, float* svec, float* vvec);
+
+	// interleaved 8-bit pixels to interleaved float output
+	static void BGR2Lab(const unsigned char* bgr, int n, float* lab);
+	static void BGR2YCbCr(const unsigned char* bgr, int n, float* ycc);
+	static void RGB2Luv(const unsigned char* rgb, int n, float* luv);
+
+private:
+	static void BuildTables();
+	static void InitTables();
+
+	static void RGB2XYZ(int r, int g, int b, double& X, double& Y, double& Z);
+	static double LabF(double t);
+	static double CubeRoot(double t);
+	static void LabPixel(int r, int g, int b, double& lval, double& aval, double& bval);
+	static bool LabPixel2(const int* r, const int* g, const int* b, double* lval, double* aval, double* bval);
+	static void LuvPixel(int r, int g, int b, double& lval, double& uval, double& vval);
+
+	enum { CBRT_TABLE_SIZE = 1024 };
+
+	static double s_Gamma[256];						// sRGB value -> linear
+	static double s_Cbrt[CBRT_TABLE_SIZE+2];		// t^(1/3) sampled on [0, CBRT_MAX]
+};
@@ -4,7 +4,7 @@
 using namespace std;
 
 // dissimilarity measure between pixels
-static inline float diff(Mat &img3f, int x1, int y1, int x2, int y2)
+static inline float diff(const Mat &img3f, int x1, int y1, int x2, int y2)
 {
 	const Vec3f &p1 = img3f.at<Vec3f>(y1, x1);
 	const Vec3f &p2 = img3f.at<Vec3f>(y2, x2);
@@ -29,9 +29,15 @@ static inline float diff(Mat &img3f, int x1, int y1, int x2, int y2)
 int SegmentImage(Mat &_src3f, Mat &pImgInd, double sigma, double c, int min_size)
 {
 	CV_Assert(_src3f.type() == CV_32FC3);
-	int width(_src3f.cols), height(_src3f.rows);
 	Mat smImg3f;
 	GaussianBlur(_src3f, smImg3f, Size(), sigma, 0, BORDER_REPLICATE);
+	return SegmentSmoothedImage(smImg3f, pImgInd, c, min_size);
+}
+
+int SegmentSmoothedImage(const Mat &smImg3f, Mat &pImgInd, double c, int min_size)
+{
+	CV_Assert(smImg3f.type() == CV_32FC3);
+	int width(smImg3f.cols), height(smImg3f.rows);
 
 	// build graph
 	edge *edges = new edge[width*height*4];
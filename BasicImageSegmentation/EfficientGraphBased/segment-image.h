@@ -44,4 +44,10 @@ using namespace cv;
 //"Default: k = 500, sigma = 1.0, min_size = 1000\n") or k = 200, sigma = 0.5, min_size = 50
 int SegmentImage(Mat &_src3f, Mat &pImgInd, double sigma = 0.5, double c = 1, int min_size = 50);
 
+/*
+* Same as SegmentImage, for an image that has already been smoothed
+* (e.g. FeatureCache::BlurredLab).
+*/
+int SegmentSmoothedImage(const Mat &smImg3f, Mat &pImgInd, double c = 1, int min_size = 50);
+
 #endif
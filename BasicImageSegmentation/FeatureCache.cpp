@@ -0,0 +1,126 @@
+#include "FeatureCache.h"
+
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "ColorConverter.h"
+
+FeatureCache::FeatureCache(const Mat& _img)
+	: m_Img(_img), m_Size(_img.rows*_img.cols)
+{
+}
+
+FeatureCache::~FeatureCache(void)
+{
+}
+
+bool FeatureCache::Matches(const Mat& _img) const
+{
+	return _img.data == m_Img.data && _img.size() == m_Img.size() && _img.type() == m_Img.type()
+		&& _img.step == m_Img.step;
+}
+
+void FeatureCache::EnsureARGB()
+{
+	if (!m_ARGB.empty())
+		return;
+
+	CV_Assert(m_Img.type() == CV_8UC3);
+	int h = m_Img.rows, w = m_Img.cols;
+	m_ARGB.resize(m_Size);
+	for (int i = 0; i < h; i++)
+	{
+		const uchar* ptr = m_Img.ptr<uchar>(i);
+		unsigned int* out = &m_ARGB[i*w];
+		for (int j = 0; j < w; j++, ptr += 3)
+		{
+			out[j] = (ptr[2]<<16) | (ptr[1]<<8) | (ptr[0]);
+		}
+	}
+}
+
+void FeatureCache::EnsureLab()
+{
+	if (!m_L.empty())
+		return;
+
+	EnsureARGB();
+	m_L.resize(m_Size); m_A.resize(m_Size); m_B.resize(m_Size);
+	ColorConverter::ARGB2Lab(&m_ARGB[0], m_Size, &m_L[0], &m_A[0], &m_B[0]);
+}
+
+void FeatureCache::EnsureLabImage()
+{
+	if (!m_LabImage.empty())
+		return;
+
+	CV_Assert(m_Img.type() == CV_8UC3);
+	m_LabImage.create(m_Img.size(), CV_32FC3);
+	for (int i = 0; i < m_Img.rows; i++)
+		ColorConverter::BGR2Lab(m_Img.ptr<uchar>(i), m_Img.cols, m_LabImage.ptr<float>(i));
+}
+
+void FeatureCache::EnsureHSV()
+{
+	if (!m_H.empty())
+		return;
+
+	EnsureARGB();
+	m_H.resize(m_Size); m_S.resize(m_Size); m_V.resize(m_Size);
+	ColorConverter::ARGB2HSV(&m_ARGB[0], m_Size, &m_H[0], &m_S[0], &m_V[0]);
+}
+
+const unsigned int* FeatureCache::ARGB()
+{
+	lock_guard<mutex> lock(m_Mutex);
+	EnsureARGB();
+	return &m_ARGB[0];
+}
+
+void FeatureCache::LabPlanes(const double*& _l, const double*& _a, const double*& _b)
+{
+	lock_guard<mutex> lock(m_Mutex);
+	EnsureLab();
+	_l = &m_L[0]; _a = &m_A[0]; _b = &m_B[0];
+}
+
+const Mat& FeatureCache::LabImage()
+{
+	lock_guard<mutex> lock(m_Mutex);
+	EnsureLabImage();
+	return m_LabImage;
+}
+
+const Mat& FeatureCache::BlurredLab(double _sigma)
+{
+	lock_guard<mutex> lock(m_Mutex);
+	map<double, Mat>::iterator iter = m_Blurred.find(_sigma);
+	if (iter != m_Blurred.end())
+		return iter->second;
+
+	EnsureLabImage();
+	Mat& smImg3f = m_Blurred[_sigma];
+	GaussianBlur(m_LabImage, smImg3f, Size(), _sigma, 0, BORDER_REPLICATE);
+	return smImg3f;
+}
+
+void FeatureCache::HSVPlanes(const float*& _h, const float*& _s, const float*& _v)
+{
+	lock_guard<mutex> lock(m_Mutex);
+	EnsureHSV();
+	_h = &m_H[0]; _s = &m_S[0]; _v = &m_V[0];
+}
+
+const unsigned int* FeatureCache::HSVBins(int _nrBins)
+{
+	lock_guard<mutex> lock(m_Mutex);
+	map<int, vector<unsigned int> >::iterator iter = m_Bins.find(_nrBins);
+	if (iter != m_Bins.end())
+		return &iter->second[0];
+
+	EnsureHSV();
+	vector<unsigned int>& bins = m_Bins[_nrBins];
+	bins.resize(m_Size);
+	for (int i = 0; i < m_Size; i++)
+		bins[i] = ColorConverter::HSV2Bin(m_H[i], m_S[i], m_V[i], _nrBins);
+	return &bins[0];
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+#include "opencv2/core/core.hpp"
+using namespace cv;
+
+// Preprocessing results for one input image, shared by all segmentors that
+// run on it. Every feature is computed on first request and kept until the
+// cache is destroyed, so a parameter sweep such as
+//     [SLIC] 9
+//     [SLIC] 15
+// converts the image only once. Features that depend
+// on a parameter are keyed by it. The returned pointers and references stay
+// valid for the lifetime of the cache; all accessors are thread-safe.
+class FeatureCache
+{
+public:
+	// The image is shared, not copied. Any type is accepted, but all the
+	// features below need an 8-bit BGR image.
+	FeatureCache(const Mat& _img);
+	~FeatureCache(void);
+
+	// true if _img is the image this cache was built for
+	bool Matches(const Mat& _img) const;
+	const Mat& Image() const { return m_Img; }
+
+	// packed 0x00RRGGBB pixels in raster order
+	const unsigned int* ARGB();
+
+	// planar CIELAB in double precision, as used by SLIC
+	void LabPlanes(const double*& _l, const double*& _a, const double*& _b);
+
+	// interleaved CIELAB, CV_32FC3
+	const Mat& LabImage();
+	// LabImage() smoothed by a Gaussian of the given sigma (border replicated)
+	const Mat& BlurredLab(double _sigma);
+
+	// planar HSV in [0,1] and the per-pixel joint histogram bin for nr_bins
+	// bins per channel, as used by SEEDS
+	void HSVPlanes(const float*& _h, const float*& _s, const float*& _v);
+	const unsigned int* HSVBins(int _nrBins);
+
+private:
+	FeatureCache(const FeatureCache&);
+	FeatureCache& operator=(const FeatureCache&);
+
+	// the Ensure* helpers expect m_Mutex to be held
+	void EnsureARGB();
+	void EnsureLab();
+	void EnsureLabImage();
+	void EnsureHSV();
+
+	Mat m_Img;
+	int m_Size;
+	mutex m_Mutex;
+
+	vector<unsigned int> m_ARGB;
+	vector<double> m_L, m_A, m_B;
+	Mat m_LabImage;
+	map<double, Mat> m_Blurred;
+	vector<float> m_H, m_S, m_V;
+	map<int, vector<unsigned int> > m_Bins;
+};
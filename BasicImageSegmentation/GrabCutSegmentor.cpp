@@ -29,9 +29,9 @@ void GrabCutSegmentor::SetArgs(const vector<float> _args)
 	m_ResultName = ss.str();
 }
 
-void GrabCutSegmentor::SetImage(const Mat& _img)
+void GrabCutSegmentor::SetImage(const Mat& _img, FeatureCache* _cache)
 {
-	Segmentor::SetImage(_img);
+	Segmentor::SetImage(_img, _cache);
 
 	m_Mask.create( m_Img.size(), CV_8UC1);
 	reset();
@@ -18,7 +18,9 @@ public:
 
 	virtual void Run();
 
-	void SetImage(const Mat& _img);
+	void SetImage(const Mat& _img, FeatureCache* _cache = NULL);
+
+	virtual bool IsInteractive() const { return true; }
 
 private:
 	static void onMouse(int event, int x, int y, int flags, void* param);
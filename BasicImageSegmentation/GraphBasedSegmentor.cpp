@@ -46,11 +46,8 @@ void GraphBasedSegmentor::Run()
 {
 	cout<<"====="<<m_Name<<" Runing..."<<endl;
 
-	Mat img3u(m_Img);
-	Mat img3f;
-	img3u.convertTo(img3f, CV_32FC3, 1.0/255);
-	cvtColor(img3f, img3f, COLOR_BGR2Lab);
-	int regionNum = SegmentImage(img3f, m_Result, m_Sigma, m_Threshold, m_MinSize);
+	const Mat& smImg3f = m_Cache->BlurredLab(m_Sigma);
+	int regionNum = SegmentSmoothedImage(smImg3f, m_Result, m_Threshold, m_MinSize);
 
 	Segmentor::Run();
 }
\ No newline at end of file
@@ -0,0 +1,354 @@
+#include "LabelMapIO.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char LABELMAP_MAGIC[4] = {'S', 'P', 'L', 'B'};
+static const int LABELMAP_VERSION = 1;
+
+// labels of one row as unsigned values, whatever the Mat depth
+template<typename T>
+static void EncodeRow(const T* row, int w, int elemWidth, unsigned char* raw,
+	uint32_t& curLabel, uint32_t& curRun, vector<unsigned char>* rle)
+{
+	for (int j = 0; j < w; j++)
+	{
+		uint32_t label = (uint32_t)row[j];
+		if (raw)
+		{
+			memcpy(raw, &label, elemWidth);	// little-endian: low bytes first
+			raw += elemWidth;
+		}
+		if (rle)
+		{
+			if (label == curLabel && curRun > 0)
+			{
+				curRun++;
+				continue;
+			}
+			if (curRun > 0)
+			{
+				size_t pos = rle->size();
+				rle->resize(pos + elemWidth + 4);
+				memcpy(&(*rle)[pos], &curLabel, elemWidth);
+				memcpy(&(*rle)[pos + elemWidth], &curRun, 4);
+			}
+			curLabel = label;
+			curRun = 1;
+		}
+	}
+}
+
+template<typename T>
+static uint32_t MaxLabel(const Mat& labels)
+{
+	uint32_t maxLabel = 0;
+	for (int i = 0; i < labels.rows; i++)
+	{
+		const T* row = labels.ptr<T>(i);
+		for (int j = 0; j < labels.cols; j++)
+		{
+			if ((uint32_t)row[j] > maxLabel)
+				maxLabel = (uint32_t)row[j];
+		}
+	}
+	return maxLabel;
+}
+
+// number of runs in raster order, rows joined
+template<typename T>
+static size_t CountRuns(const Mat& labels)
+{
+	size_t runs = 0;
+	uint32_t curLabel = 0;
+	for (int i = 0; i < labels.rows; i++)
+	{
+		const T* row = labels.ptr<T>(i);
+		for (int j = 0; j < labels.cols; j++)
+		{
+			uint32_t label = (uint32_t)row[j];
+			if (label != curLabel || runs == 0)
+			{
+				runs++;
+				curLabel = label;
+			}
+		}
+	}
+	return runs;
+}
+
+template<typename T>
+static void EncodeLabels(const Mat& labels, int elemWidth, unsigned char* raw, vector<unsigned char>* rle)
+{
+	uint32_t curLabel = 0, curRun = 0;
+	for (int i = 0; i < labels.rows; i++)
+	{
+		EncodeRow(labels.ptr<T>(i), labels.cols, elemWidth, raw, curLabel, curRun, rle);
+		if (raw)
+			raw += (size_t)labels.cols*elemWidth;
+	}
+	if (rle && curRun > 0)
+	{
+		size_t pos = rle->size();
+		rle->resize(pos + elemWidth + 4);
+		memcpy(&(*rle)[pos], &curLabel, elemWidth);
+		memcpy(&(*rle)[pos + elemWidth], &curRun, 4);
+	}
+}
+
+bool LabelMapWriter::Write(const Mat& _labels, const string& _fileName)
+{
+	int depth = _labels.depth();
+	CV_Assert(_labels.channels() == 1 && (depth == CV_8U || depth == CV_16U || depth == CV_32S));
+
+	uint32_t maxLabel = depth == CV_8U ? MaxLabel<uchar>(_labels)
+		: depth == CV_16U ? MaxLabel<ushort>(_labels) : MaxLabel<int>(_labels);
+	int elemWidth = maxLabel <= 0xFF ? 1 : maxLabel <= 0xFFFF ? 2 : 4;
+
+	LabelMapHeader header;
+	memcpy(header.magic, LABELMAP_MAGIC, 4);
+	header.version = LABELMAP_VERSION;
+	header.elemWidth = elemWidth;
+	header.width = _labels.cols;
+	header.height = _labels.rows;
+	header.labelCount = (_labels.rows*_labels.cols > 0) ? maxLabel + 1 : 0;
+
+	// size the run-length encoding first and only build the smaller one
+	size_t rawSize = (size_t)_labels.rows*_labels.cols*elemWidth;
+	size_t runs = depth == CV_8U ? CountRuns<uchar>(_labels)
+		: depth == CV_16U ? CountRuns<ushort>(_labels) : CountRuns<int>(_labels);
+	size_t rleSize = runs*(elemWidth + 4);
+
+	vector<unsigned char> buffer(sizeof(LabelMapHeader));
+	if (rleSize < rawSize)
+	{
+		header.encoding = LABELMAP_RLE;
+		buffer.reserve(sizeof(LabelMapHeader) + rleSize);
+		if (depth == CV_8U) EncodeLabels<uchar>(_labels, elemWidth, NULL, &buffer);
+		else if (depth == CV_16U) EncodeLabels<ushort>(_labels, elemWidth, NULL, &buffer);
+		else EncodeLabels<int>(_labels, elemWidth, NULL, &buffer);
+	}
+	else
+	{
+		header.encoding = LABELMAP_RAW;
+		buffer.resize(sizeof(LabelMapHeader) + rawSize);
+		unsigned char* raw = rawSize ? &buffer[sizeof(LabelMapHeader)] : NULL;
+		if (depth == CV_8U) EncodeLabels<uchar>(_labels, elemWidth, raw, NULL);
+		else if (depth == CV_16U) EncodeLabels<ushort>(_labels, elemWidth, raw, NULL);
+		else EncodeLabels<int>(_labels, elemWidth, raw, NULL);
+	}
+	header.payloadSize = buffer.size() - sizeof(LabelMapHeader);
+	memcpy(&buffer[0], &header, sizeof(LabelMapHeader));
+
+	FILE* f = fopen(_fileName.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	size_t written = fwrite(&buffer[0], 1, buffer.size(), f);
+	fclose(f);
+	return written == buffer.size();
+}
+
+LabelMapStreamWriter::LabelMapStreamWriter(void)
+{
+	m_File = NULL;
+	m_Rows = 0;
+	memset(&m_Header, 0, sizeof(m_Header));
+}
+
+LabelMapStreamWriter::~LabelMapStreamWriter(void)
+{
+	if (m_File)
+		fclose(m_File);
+}
+
+bool LabelMapStreamWriter::Open(const string& _fileName, int _width, int _height)
+{
+	if (m_File)
+		fclose(m_File);
+	m_Rows = 0;
+	memcpy(m_Header.magic, LABELMAP_MAGIC, 4);
+	m_Header.version = LABELMAP_VERSION;
+	m_Header.elemWidth = 4;
+	m_Header.width = _width;
+	m_Header.height = _height;
+	m_Header.labelCount = 0;
+	m_Header.encoding = LABELMAP_RAW;
+	m_Header.payloadSize = (uint64_t)_width*_height*4;
+
+	m_File = fopen(_fileName.c_str(), "wb");
+	if (m_File == NULL)
+		return false;
+	// the label count is patched in by Close
+	return fwrite(&m_Header, sizeof(LabelMapHeader), 1, m_File) == 1;
+}
+
+bool LabelMapStreamWriter::WriteRows(const int* _labels, int _rows)
+{
+	if (m_File == NULL || m_Rows + _rows > (int)m_Header.height)
+		return false;
+	size_t count = (size_t)_rows*m_Header.width;
+	if (fwrite(_labels, 4, count, m_File) != count)	// little-endian, like the header
+		return false;
+	m_Rows += _rows;
+	return true;
+}
+
+bool LabelMapStreamWriter::Close(int _labelCount)
+{
+	if (m_File == NULL)
+		return false;
+	bool ok = m_Rows == (int)m_Header.height;
+	m_Header.labelCount = _labelCount;
+	ok = ok && fseek(m_File, 0, SEEK_SET) == 0
+		&& fwrite(&m_Header, sizeof(LabelMapHeader), 1, m_File) == 1;
+	ok = (fclose(m_File) == 0) && ok;
+	m_File = NULL;
+	return ok;
+}
+
+LabelMapReader::LabelMapReader(void)
+{
+	memset(&m_Header, 0, sizeof(m_Header));
+	m_Data = NULL;
+	m_Size = 0;
+#ifdef _WIN32
+	m_File = INVALID_HANDLE_VALUE;
+	m_Mapping = NULL;
+#endif
+}
+
+LabelMapReader::~LabelMapReader(void)
+{
+	Close();
+}
+
+bool LabelMapReader::Open(const string& _fileName)
+{
+	Close();
+
+#ifdef _WIN32
+	m_File = CreateFileA(_fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_File == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_File, &size) || size.QuadPart < (LONGLONG)sizeof(LabelMapHeader))
+	{
+		Close();
+		return false;
+	}
+	m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_Mapping == NULL)
+	{
+		Close();
+		return false;
+	}
+	m_Data = (const unsigned char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+	m_Size = (size_t)size.QuadPart;
+#else
+	int fd = open(_fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LabelMapHeader))
+	{
+		close(fd);
+		return false;
+	}
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	m_Data = (data == MAP_FAILED) ? NULL : (const unsigned char*)data;
+	m_Size = st.st_size;
+#endif
+	if (m_Data == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	memcpy(&m_Header, m_Data, sizeof(LabelMapHeader));
+	int ew = m_Header.elemWidth;
+	bool valid = memcmp(m_Header.magic, LABELMAP_MAGIC, 4) == 0
+		&& m_Header.version == LABELMAP_VERSION
+		&& (ew == 1 || ew == 2 || ew == 4)
+		&& (m_Header.encoding == LABELMAP_RAW || m_Header.encoding == LABELMAP_RLE)
+		&& m_Header.payloadSize <= m_Size - sizeof(LabelMapHeader);
+	if (valid && m_Header.encoding == LABELMAP_RAW)
+		valid = m_Header.payloadSize == (uint64_t)m_Header.width*m_Header.height*ew;
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void LabelMapReader::Close()
+{
+#ifdef _WIN32
+	if (m_Data)
+		UnmapViewOfFile(m_Data);
+	if (m_Mapping)
+		CloseHandle(m_Mapping);
+	if (m_File != INVALID_HANDLE_VALUE)
+		CloseHandle(m_File);
+	m_Mapping = NULL;
+	m_File = INVALID_HANDLE_VALUE;
+#else
+	if (m_Data)
+		munmap((void*)m_Data, m_Size);
+#endif
+	m_Data = NULL;
+	m_Size = 0;
+	memset(&m_Header, 0, sizeof(m_Header));
+}
+
+const void* LabelMapReader::RawData() const
+{
+	if (m_Data == NULL || m_Header.encoding != LABELMAP_RAW)
+		return NULL;
+	return m_Data + sizeof(LabelMapHeader);
+}
+
+bool LabelMapReader::GetLabels(Mat& _labels) const
+{
+	if (m_Data == NULL)
+		return false;
+
+	int ew = m_Header.elemWidth;
+	int type = ew == 1 ? CV_8UC1 : ew == 2 ? CV_16UC1 : CV_32SC1;
+	int h = m_Header.height, w = m_Header.width;
+
+	if (m_Header.encoding == LABELMAP_RAW)
+	{
+		_labels = Mat(h, w, type, (void*)RawData());
+		return true;
+	}
+
+	_labels.create(h, w, type);
+	unsigned char* out = _labels.data;
+	size_t total = (size_t)w*h, filled = 0;
+	const unsigned char* rec = m_Data + sizeof(LabelMapHeader);
+	const unsigned char* end = rec + m_Header.payloadSize;
+	for ( ; rec + ew + 4 <= end; rec += ew + 4)
+	{
+		uint32_t run;
+		memcpy(&run, rec + ew, 4);
+		if (run > total - filled)
+			return false;
+		for (uint32_t k = 0; k < run; k++, out += ew)
+			memcpy(out, rec, ew);
+		filled += run;
+	}
+	return filled == total;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <stdint.h>
+using namespace std;
+
+#include "opencv2/core/core.hpp"
+using namespace cv;
+
+// Binary label-map files (".lbl"), little-endian:
+//
+//   offset  size  field
+//        0     4  magic "SPLB"
+//        4     2  version (1)
+//        6     2  element width in bytes: 1, 2 or 4
+//        8     4  width
+//       12     4  height
+//       16     4  label count (max label + 1)
+//       20     4  encoding: 0 = raw, 1 = run-length
+//       24     8  payload size in bytes
+//       32        payload
+//
+// A raw payload holds width*height labels in raster order. A run-length
+// payload is a sequence of (label, run) records, the label stored in the
+// element width and the run as uint32, following the raster order across
+// row ends. The writer picks whichever encoding is smaller; superpixel
+// maps usually shrink by an order of magnitude with run-lengths.
+struct LabelMapHeader
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t elemWidth;
+	uint32_t width;
+	uint32_t height;
+	uint32_t labelCount;
+	uint32_t encoding;
+	uint64_t payloadSize;
+};
+
+enum { LABELMAP_RAW = 0, LABELMAP_RLE = 1 };
+
+class LabelMapWriter
+{
+public:
+	// _labels is CV_8UC1, CV_16UC1 or CV_32SC1 with labels >= 0. The file is
+	// assembled in memory and written with a single call.
+	static bool Write(const Mat& _labels, const string& _fileName);
+};
+
+// Writes a raw label map a few rows at a time, for maps too large to hold in
+// memory. Labels are stored in 4 bytes; Close() fills in the label count.
+class LabelMapStreamWriter
+{
+public:
+	LabelMapStreamWriter(void);
+	~LabelMapStreamWriter(void);
+
+	bool Open(const string& _fileName, int _width, int _height);
+	// _rows rows of CV_32SC1-like labels, in top-to-bottom order
+	bool WriteRows(const int* _labels, int _rows);
+	// fails unless all rows were written
+	bool Close(int _labelCount);
+
+private:
+	LabelMapStreamWriter(const LabelMapStreamWriter&);
+	LabelMapStreamWriter& operator=(const LabelMapStreamWriter&);
+
+	FILE* m_File;
+	LabelMapHeader m_Header;
+	int m_Rows;		// rows written so far
+};
+
+// Memory-maps a label-map file. For a raw payload, GetLabels returns a Mat
+// header over the mapping without copying; it stays valid until Close().
+class LabelMapReader
+{
+public:
+	LabelMapReader(void);
+	~LabelMapReader(void);
+
+	bool Open(const string& _fileName);
+	void Close();
+
+	int Width() const { return m_Header.width; }
+	int Height() const { return m_Header.height; }
+	int LabelCount() const { return m_Header.labelCount; }
+	int ElementWidth() const { return m_Header.elemWidth; }
+	bool IsCompressed() const { return m_Header.encoding != LABELMAP_RAW; }
+
+	// raw payload, NULL if the file is run-length encoded
+	const void* RawData() const;
+
+	// CV_8UC1, CV_16UC1 or CV_32SC1 depending on the element width. Must be
+	// treated as read-only when the payload is raw (it points into the file).
+	bool GetLabels(Mat& _labels) const;
+
+private:
+	LabelMapReader(const LabelMapReader&);
+	LabelMapReader& operator=(const LabelMapReader&);
+
+	LabelMapHeader m_Header;
+	const unsigned char* m_Data;	// start of the mapping
+	size_t m_Size;
+#ifdef _WIN32
+	void* m_File;
+	void* m_Mapping;
+#endif
+};
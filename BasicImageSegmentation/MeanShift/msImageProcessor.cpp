@@ -32,6 +32,7 @@ Implemented by Chris M. Christoudias, Bogdan Georgescu
 
 //include image processor class prototype
 #include	"msImageProcessor.h"
+#include	"../ColorConverter.h"
 
 //include needed libraries
 #include	<math.h>
@@ -167,8 +168,7 @@ void msImageProcessor::DefineImage(_byte *data_, imageType type, int height_, in
 	}
 	else
 	{
-		for(i = 0; i < height_*width_; i++)
-			RGBtoLUV(&data_[dim*i], &luv[dim*i]);
+		ColorConverter::RGB2Luv(data_, height_*width_, luv);
 	}
 
 	//define input defined on a lattice using mean shift base class
@@ -215,8 +215,7 @@ void msImageProcessor::DefineBgImage(_byte* data_, imageType type, int height_,
 	}
 	else
 	{
-		for(i = 0; i < height_*width_; i++)
-			RGBtoLUV(&data_[dim*i], &luv[dim*i]);
+		ColorConverter::RGB2Luv(data_, height_*width_, luv);
 	}
 
 	//define input defined on a lattice using mean shift base class
@@ -820,40 +819,8 @@ void msImageProcessor::Segment(int sigmaS, float sigmaR, int minRegion, SpeedUpL
 
 void msImageProcessor::RGBtoLUV(_byte *rgbVal, float *luvVal)
 {
-
-	//delcare variables
-	double	x, y, z, L0, u_prime, v_prime, constant;
-
-	//convert RGB to XYZ...
-	x		= XYZ[0][0]*rgbVal[0] + XYZ[0][1]*rgbVal[1] + XYZ[0][2]*rgbVal[2];
-	y		= XYZ[1][0]*rgbVal[0] + XYZ[1][1]*rgbVal[1] + XYZ[1][2]*rgbVal[2];
-	z		= XYZ[2][0]*rgbVal[0] + XYZ[2][1]*rgbVal[1] + XYZ[2][2]*rgbVal[2];
-
-	//convert XYZ to LUV...
-
-	//compute L*
-	L0		= y / (255.0 * Yn);
-	if(L0 > Lt)
-		luvVal[0]	= (float)(116.0 * (pow(L0, 1.0/3.0)) - 16.0);
-	else
-		luvVal[0]	= (float)(903.3 * L0);
-
-	//compute u_prime and v_prime
-	constant	= x + 15 * y + 3 * z;
-	if(constant != 0)
-	{
-		u_prime	= (4 * x) / constant;
-		v_prime = (9 * y) / constant;
-	}
-	else
-	{
-		u_prime	= 4.0;
-		v_prime	= 9.0/15.0;
-	}
-
-	//compute u* and v*
-    luvVal[1] = (float) (13 * luvVal[0] * (u_prime - Un_prime));
-    luvVal[2] = (float) (13 * luvVal[0] * (v_prime - Vn_prime));
+	//conversion is shared with the other segmentors
+	ColorConverter::RGB2Luv(rgbVal, 1, luvVal);
 
 	//done.
 	return;
@@ -875,58 +842,10 @@ void msImageProcessor::RGBtoLUV(_byte *rgbVal, float *luvVal)
 /*        result has been stored in rgbVal.            */
 /*******************************************************/
 
-//define inline rounding function...
-inline int my_round(double in_x)
-{
-	if (in_x < 0)
-		return (int)(in_x - 0.5);
-	else
-		return (int)(in_x + 0.5);
-}
-
 void msImageProcessor::LUVtoRGB(float *luvVal, _byte *rgbVal)
 {
-	//declare variables...
-	int		r, g, b;
-	double	x, y, z, u_prime, v_prime;
-
-	//perform conversion
-	if(luvVal[0] < 0.1)
-		r = g = b = 0;
-	else
-	{
-		//convert luv to xyz...
-		if(luvVal[0] < 8.0)
-			y	= Yn * luvVal[0] / 903.3;
-		else
-		{
-			y	= (luvVal[0] + 16.0) / 116.0;
-			y  *= Yn * y * y;
-		}
-
-		u_prime	= luvVal[1] / (13 * luvVal[0]) + Un_prime;
-		v_prime	= luvVal[2] / (13 * luvVal[0]) + Vn_prime;
-
-		x		= 9 * u_prime * y / (4 * v_prime);
-		z		= (12 - 3 * u_prime - 20 * v_prime) * y / (4 * v_prime);
-
-		//convert xyz to rgb...
-		//[r, g, b] = RGB*[x, y, z]*255.0
-		r		= my_round((RGB[0][0]*x + RGB[0][1]*y + RGB[0][2]*z)*255.0);
-		g		= my_round((RGB[1][0]*x + RGB[1][1]*y + RGB[1][2]*z)*255.0);
-		b		= my_round((RGB[2][0]*x + RGB[2][1]*y + RGB[2][2]*z)*255.0);
-
-		//check bounds...
-		if(r < 0)	r = 0; if(r > 255)	r = 255;
-		if(g < 0)	g = 0; if(g > 255)	g = 255;
-		if(b < 0)	b = 0; if(b > 255)	b = 255;
-
-	}
-
-	//assign rgb values to rgb vector rgbVal
-	rgbVal[0]	= r;
-	rgbVal[1]	= g;
-	rgbVal[2]	= b;
+	//conversion is shared with the other segmentors
+	ColorConverter::Luv2RGB(luvVal, rgbVal);
 
 	//done.
 	return;
@@ -24,6 +24,8 @@ public:
 
 	virtual void Run();
 
+	virtual bool IsInteractive() const { return true; }
+
 private:
 	static void onMouse(int event, int x, int y, int flags, void* param);
 
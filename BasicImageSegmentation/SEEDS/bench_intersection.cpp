@@ -0,0 +1,147 @@
+// ******************************************************************************
+// Microbenchmark of the SEEDS histogram intersection (see ReadMe.md)
+// ******************************************************************************
+// Scores block moves as update_blocks() does: a 16-bit block histogram is
+// intersected with the histograms of the two superpixels it may belong to.
+// Times the scalar reference loop, two calls of intersect_histograms(), and
+// the fused intersect_histograms() that reads the block histogram once, for
+// 5, 8 and 16 bins per channel, and checks that all three agree exactly.
+//
+// It includes seeds2.cpp to reach the file-local intersect_histograms(), so
+// it is built on its own rather than in the project, e.g.
+//
+//   g++ -O2 bench_intersection.cpp ../ColorConverter.cpp -o bench_intersection
+//   g++ -O2 -mavx bench_intersection.cpp ../ColorConverter.cpp -o bench_intersection_avx
+//   cl /O2 /EHsc bench_intersection.cpp ..\ColorConverter.cpp
+//   cl /O2 /EHsc /arch:AVX bench_intersection.cpp ..\ColorConverter.cpp
+//
+// The histograms are synthetic and sparse: a quarter of the superpixel bins
+// and a sixth of the block bins are non-zero.
+// ******************************************************************************
+
+#include "seeds2.cpp"
+
+#ifdef _MSC_VER
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+// the loop of intersect_histograms() without SIMD
+template<typename A, typename B>
+BENCH_NOINLINE static float scalar_intersection(const A* h1, const int count1, const B* h2, const int count2, int n)
+{
+	int sum1 = 0, sum2 = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (h1[i] * count2 < h2[i] * count1) sum1 += h1[i];
+		else sum2 += h2[i];
+	}
+	return ((float)sum1)/(float)count1 + ((float)sum2)/(float)count2;
+}
+
+template<typename A, typename B>
+BENCH_NOINLINE static float simd_intersection(const A* h1, const int count1, const B* h2, const int count2, int n)
+{
+	return intersect_histograms(h1, count1, h2, count2, n);
+}
+
+BENCH_NOINLINE static void fused_intersections(const int* hA, int countA, const int* hB, int countB,
+	const unsigned short* h, int count, int n, float* intA, float* intB)
+{
+	intersect_histograms(hA, countA, hB, countB, h, count, n, intA, intB);
+}
+
+int main()
+{
+#if defined(SEEDS_SSE41)
+	const char* simd = "SSE4.1";
+#elif defined(SEEDS_SSE2)
+	const char* simd = "SSE2";
+#else
+	const char* simd = "none";
+#endif
+	printf("SIMD path: %s\n", simd);
+	printf("bins  size  scalar ns  two calls ns  fused ns  (per block move)\n");
+
+	srand(1);
+	const int bins_list[3] = {5, 8, 16};
+	const int nr_blocks = 64;
+	int failed = 0;
+	for (int b = 0; b < 3; b++)
+	{
+		const int n = bins_list[b]*bins_list[b]*bins_list[b];
+
+		// superpixels 2k and 2k+1 are the candidates of block k
+		std::vector<int> top(nr_blocks*2*n), top_count(nr_blocks*2);
+		std::vector<unsigned short> block(nr_blocks*n);
+		std::vector<int> block_count(nr_blocks);
+		for (int k = 0; k < nr_blocks*2; k++)
+		{
+			int sum = 0;
+			for (int i = 0; i < n; i++) { int v = rand()%4 == 0 ? rand()%200 : 0; top[k*n+i] = v; sum += v; }
+			top_count[k] = sum + 1;
+		}
+		for (int k = 0; k < nr_blocks; k++)
+		{
+			int sum = 0;
+			for (int i = 0; i < n; i++) { int v = rand()%6 == 0 ? rand()%12 : 0; block[k*n+i] = (unsigned short)v; sum += v; }
+			block_count[k] = sum + 1;
+		}
+
+		for (int k = 0; k < nr_blocks; k++)
+		{
+			const int* hA = &top[2*k*n];
+			const int* hB = &top[(2*k+1)*n];
+			const unsigned short* h = &block[k*n];
+			float intA, intB;
+			fused_intersections(hA, top_count[2*k], hB, top_count[2*k+1], h, block_count[k], n, &intA, &intB);
+			float refA = scalar_intersection(hA, top_count[2*k], h, block_count[k], n);
+			float refB = scalar_intersection(hB, top_count[2*k+1], h, block_count[k], n);
+			if (intA != refA || intB != refB || simd_intersection(hA, top_count[2*k], h, block_count[k], n) != refA)
+				failed++;
+		}
+
+		// best of 3 runs of about the same number of bins each
+		const int reps = 2000000/n;
+		volatile float sink = 0;
+		double best[3] = {1e30, 1e30, 1e30};
+		for (int run = 0; run < 3; run++)
+		{
+			double t = seeds_seconds();
+			for (int r = 0; r < reps; r++)
+				for (int k = 0; k < nr_blocks; k++)
+				{
+					sink += scalar_intersection(&top[2*k*n], top_count[2*k], &block[k*n], block_count[k], n);
+					sink += scalar_intersection(&top[(2*k+1)*n], top_count[2*k+1], &block[k*n], block_count[k], n);
+				}
+			best[0] = std::min(best[0], seeds_seconds() - t);
+
+			t = seeds_seconds();
+			for (int r = 0; r < reps; r++)
+				for (int k = 0; k < nr_blocks; k++)
+				{
+					sink += simd_intersection(&top[2*k*n], top_count[2*k], &block[k*n], block_count[k], n);
+					sink += simd_intersection(&top[(2*k+1)*n], top_count[2*k+1], &block[k*n], block_count[k], n);
+				}
+			best[1] = std::min(best[1], seeds_seconds() - t);
+
+			t = seeds_seconds();
+			for (int r = 0; r < reps; r++)
+				for (int k = 0; k < nr_blocks; k++)
+				{
+					float intA, intB;
+					fused_intersections(&top[2*k*n], top_count[2*k], &top[(2*k+1)*n], top_count[2*k+1],
+						&block[k*n], block_count[k], n, &intA, &intB);
+					sink += intA + intB;
+				}
+			best[2] = std::min(best[2], seeds_seconds() - t);
+		}
+
+		const double ns = 1e9/(double(reps)*nr_blocks);
+		printf("%4d  %4d  %9.0f  %12.0f  %8.0f\n", bins_list[b], n, best[0]*ns, best[1]*ns, best[2]*ns);
+	}
+
+	if (failed) printf("%d mismatches against the scalar loop\n", failed);
+	return failed ? 1 : 0;
+}
@@ -13,8 +13,10 @@
 // ******************************************************************************
 
 #include "seeds2.h"
+#include "../ColorConverter.h"
 #include "math.h"
 #include <cstdio>
+#include <cstdlib>
 #include <algorithm>
 #include <vector>
 #include <iostream>
@@ -39,32 +41,109 @@
 
 #define MINIMUM_NR_SUBLABELS 1
 
+// Store the histograms of the lower levels with 16-bit counts where the
+// blocks are small enough. Halves the memory traffic of update_blocks.
+#define COMPACT_HISTOGRAMS
 
+// SIMD histogram intersection; SSE4.1 comes with every AVX target (MSVC
+// has no switch for SSE4.1 alone)
+#if defined(__AVX__) || defined(__SSE4_1__)
+#include <smmintrin.h>
+#define SEEDS_SSE41
+#endif
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SEEDS_SSE2
+#endif
+
+
+
+// Wall clock with sub-millisecond resolution for the step budget
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define VC_EXTRALEAN
+#define NOMINMAX
+#include <windows.h>
+static double seeds_seconds()
+{
+	static LARGE_INTEGER frequency = {0};
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return double(now.QuadPart) / double(frequency.QuadPart);
+}
+#else
+#include <time.h>
+static double seeds_seconds()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + 1e-9*now.tv_nsec;
+}
+#endif
 
 void SEEDS::iterate() 
 {
+	iterate(-1);
+}
+
+// whether a step expected to take `expected` seconds still fits the budget;
+// a step with no estimate (expected <= 0) only runs as the first of a call
+static bool step_fits(double start, double max_seconds, int steps, int max_steps, double expected)
+{
+	if (max_steps >= 0 && steps >= max_steps) return false;
+	if (max_seconds >= 0 && expected <= 0 && steps > 0) return false;
+	if (max_seconds >= 0 && seeds_seconds() - start + expected > max_seconds) return false;
+	return true;
+}
+
+bool SEEDS::iterate(double max_seconds, int max_steps)
+{
+	const double start = seeds_seconds();
+	int steps = 0;
+
 	// block updates
 	while (seeds_current_level >= 0)
 	{
+		// a level that has not run yet is estimated from the one above it:
+		// most of the work is on the boundary blocks, whose number grows with
+		// the square root of the block count
+		double expected = level_seconds[seeds_current_level];
+		if (expected <= 0 && seeds_current_level + 1 < seeds_nr_levels && level_seconds[seeds_current_level + 1] > 0)
+			expected = level_seconds[seeds_current_level + 1] * sqrt((double)nr_labels[seeds_current_level] / nr_labels[seeds_current_level + 1]);
+		if (!step_fits(start, max_seconds, steps, max_steps, expected)) return false;
+		const double t = seeds_seconds();
 #ifdef DOUBLE_STEPS
 	  update_blocks(seeds_current_level, REQ_CONF);
 #endif
 		update_blocks(seeds_current_level);
+		level_seconds[seeds_current_level] = seeds_seconds() - t;
 		seeds_current_level = go_down_one_level();
+		steps++;
 	}
 
+	// pixel updates
+	while (pixel_passes_done < nr_pixel_passes)
+	{
+		// before the first pass, the block update of level 0 is the estimate;
+		// a pass has taken less than that on all sizes tried
+		const double expected = pixel_pass_seconds > 0 ? pixel_pass_seconds : level_seconds[0];
+		if (!step_fits(start, max_seconds, steps, max_steps, expected)) return false;
+		const double t = seeds_seconds();
 #ifdef MEANS
-	compute_means();
-	update_pixels_means();
-	update_pixels_means();
-	update_pixels_means();
-	update_pixels_means();
+		if (pixel_passes_done == 0) compute_means();
+		if (nr_threads > 1) update_pixels_parallel(true);
+		else update_pixels_means();
 #else
-	update_pixels();
-	update_pixels();
-	update_pixels();
-	update_pixels();
+		if (nr_threads > 1) update_pixels_parallel(false);
+		else update_pixels();
 #endif
+		pixel_pass_seconds = seeds_seconds() - t;
+		pixel_passes_done++;
+		steps++;
+	}
+	return true;
 }
 
 
@@ -78,140 +157,193 @@ SEEDS::SEEDS(int width, int height, int nr_channels, int nr_bins)
 	this->nr_channels = nr_channels;
 	this->nr_bins = nr_bins;
 
-	image_bins = new UINT[width*height];
-	image_l = new float[width*height];
-	image_a = new float[width*height];
-	image_b = new float[width*height];
 	forwardbackward = true;
+	nr_pixel_passes = 4;
+	pixel_passes_done = 0;
+	pixel_pass_seconds = 0;
 	histogram_size = nr_bins*nr_bins*nr_bins;
 	initialized = false;
+	arena = NULL;
+	means = NULL;
+	have_frame = false;
+	nr_threads = 1;
 }
 
 SEEDS::~SEEDS()
 {
-  deinitialize();
-  
-	// from constructor
-	delete[] image_bins;
-	delete[] image_l;
-	delete[] image_a;
-	delete[] image_b;
+	deinitialize();
+	delete[] means;
 }
 void SEEDS::deinitialize() 
 {
-  if(initialized) 
-  {
-    initialized = false;
-		for (int level=0; level<seeds_nr_levels; level++)
-		{
-			for (UINT label=0; label<nr_labels[level]; label++)
-			{
-				delete[] histogram[level][label];
-			}
-			delete[]  histogram[level];
-			delete[] T[level];
-			delete[] labels[level];
-			delete[] parent[level];
-			delete[] nr_partitions[level];
-
-		}
-		delete[] histogram;
-		delete[] T;
-		delete[] labels;
-		delete[] parent;
-		delete[] nr_partitions;
-		delete[] nr_labels;
-		delete[] nr_w;
-		delete[] nr_h;
-		
-#ifdef LAB_COLORSPACE
-		delete[] bin_cutoff1;
-		delete[] bin_cutoff2;
-		delete[] bin_cutoff3;
-#endif
-		
-#ifdef MEANS
-		delete[] L_channel;
-		delete[] A_channel;
-		delete[] B_channel;
-#endif
-  }
+	if(initialized) 
+	{
+		initialized = false;
+		delete[] arena;
+		arena = NULL;
+	}
 }
 
 
+// reserves bytes at the end of an arena of size total, aligned to a cache line
+static size_t arena_reserve(size_t& total, size_t bytes)
+{
+	size_t offset = total;
+	total = (total + bytes + 63) & ~size_t(63);
+	return offset;
+}
+
+// largest block size at a level, as laid out by assign_labels(): the last
+// block in each direction also takes the remainder of the image
+static int max_block_size(int size, int nr_blocks, int step)
+{
+	if (nr_blocks <= 1) return size;
+	int last = size - (nr_blocks-1)*step;
+	return last > step ? last : step;
+}
 
 void SEEDS::initialize(int seeds_w, int seeds_h, int nr_levels)
 {
-  deinitialize();
-  
+	deinitialize();
+
 	this->seeds_w = seeds_w;
 	this->seeds_h = seeds_h;
 	this->seeds_nr_levels = nr_levels;
 	this->seeds_top_level = nr_levels - 1;
 
-	// init labels
-  labels = new UINT*[seeds_nr_levels];
-  parent = new UINT*[seeds_nr_levels];
-  nr_partitions = new UINT*[seeds_nr_levels];
-  nr_labels = new UINT[seeds_nr_levels];
-  nr_w = new int[seeds_nr_levels];
-  nr_h = new int[seeds_nr_levels];
-  int level = 0;
-  int nr_seeds_w = floor(width/seeds_w);
-  int nr_seeds_h = floor(height/seeds_h);
-  int nr_seeds = nr_seeds_w*nr_seeds_h;
-  nr_labels[level] = nr_seeds;
-  nr_w[level] = nr_seeds_w;
-  nr_h[level] = nr_seeds_h;
-  labels[level] = new UINT[width*height];
-  parent[level] = new UINT[nr_seeds];
-  nr_partitions[level] = new UINT[nr_seeds];
-  for (level = 1; level < seeds_nr_levels; level++)
-  {
-    nr_seeds_w /= 2; // always partitioned in 2x2 sub-blocks
-    nr_seeds_h /= 2; // always partitioned in 2x2 sub-blocks
-    nr_seeds = nr_seeds_w*nr_seeds_h;
-    labels[level] = new UINT[width*height];
-    parent[level] = new UINT[nr_seeds];
-    nr_partitions[level] = new UINT[nr_seeds];
-    nr_labels[level] = nr_seeds;
-    nr_w[level] = nr_seeds_w;
-    nr_h[level] = nr_seeds_h;
-  }
-	
-	
+	// number of blocks per level
+	vector<int> level_w(nr_levels), level_h(nr_levels);
+	level_w[0] = floor(width/seeds_w);
+	level_h[0] = floor(height/seeds_h);
+	for (int level = 1; level < nr_levels; level++)
+	{
+		level_w[level] = level_w[level-1] / 2; // always partitioned in 2x2 sub-blocks
+		level_h[level] = level_h[level-1] / 2; // always partitioned in 2x2 sub-blocks
+	}
+
+	// 16-bit counts for the levels below the top whose blocks are small
+	// enough; the top level grows and shrinks with the block moves
+	vector<char> compact(nr_levels, 0);
+#ifdef COMPACT_HISTOGRAMS
+	for (int level = 0; level < seeds_top_level; level++)
+	{
+		long long bw = max_block_size(width, level_w[level], seeds_w << level);
+		long long bh = max_block_size(height, level_h[level], seeds_h << level);
+		compact[level] = bw*bh <= 65535;
+	}
+#endif
+	histogram_stride = (histogram_size + 15) & ~15;	// 64-byte histograms
+	histogram16_stride = (histogram_size + 31) & ~31;
+
+	// lay out the arena
+	const size_t sz = size_t(width)*height;
+	size_t total = 0;
+	size_t off_tables = arena_reserve(total, 7*nr_levels*sizeof(void*));
+	size_t off_counts = arena_reserve(total, 3*nr_levels*sizeof(int));
+	vector<size_t> off_labels(nr_levels), off_parent(nr_levels), off_partitions(nr_levels), off_T(nr_levels), off_hist(nr_levels);
+	for (int level = 0; level < nr_levels; level++)
+	{
+		const size_t n = size_t(level_w[level])*level_h[level];
+		off_labels[level] = arena_reserve(total, sz*sizeof(UINT));
+		off_parent[level] = arena_reserve(total, n*sizeof(UINT));
+		off_partitions[level] = arena_reserve(total, n*sizeof(UINT));
+		off_T[level] = arena_reserve(total, n*sizeof(int));
+		off_hist[level] = compact[level] ? arena_reserve(total, n*histogram16_stride*sizeof(unsigned short))
+			: arena_reserve(total, n*histogram_stride*sizeof(int));
+	}
+	size_t off_bins = arena_reserve(total, sz*sizeof(UINT));
+	size_t off_planes = arena_reserve(total, 3*sz*sizeof(float));
 #ifdef MEANS
-	L_channel = new float[nr_labels[seeds_top_level]];
-	A_channel = new float[nr_labels[seeds_top_level]];
-	B_channel = new float[nr_labels[seeds_top_level]];
+	const size_t nr_top = size_t(level_w[seeds_top_level])*level_h[seeds_top_level];
+	size_t off_means = arena_reserve(total, 3*nr_top*sizeof(float));
+#endif
+#ifdef LAB_COLORSPACE
+	size_t off_cutoff = arena_reserve(total, 3*nr_bins*sizeof(float));
 #endif
 
-	
-  // create histogram buffers
-  histogram = new int**[seeds_nr_levels]; // histograms are kept for each level and each label [level][label][bin]
-  T = new int*[seeds_nr_levels]; // block sizes are kept at each level [level][label]
-  for (int level=0; level<seeds_nr_levels; level++)
-  {
-    histogram[level] = new int*[nr_labels[level]]; // histograms are kept for each level and each label [level][label][bin]
-    T[level] = new int[nr_labels[level]]; // block sizes are kept at each level [level][label]
-    for (UINT label=0; label<nr_labels[level]; label++)
-    {
-      histogram[level][label] = new int[histogram_size]; // histogram bins
-    }
-  }
-  
+	arena = new char[total + 63];
+	char* base = (char*)(((size_t)arena + 63) & ~size_t(63));
+
+	void** tables = (void**)(base + off_tables);
+	labels = (UINT**)tables;
+	parent = (UINT**)(tables + nr_levels);
+	nr_partitions = (UINT**)(tables + 2*nr_levels);
+	T = (int**)(tables + 3*nr_levels);
+	histogram = (int**)(tables + 4*nr_levels);
+	histogram16 = (unsigned short**)(tables + 5*nr_levels);
+	nr_labels = (UINT*)(base + off_counts);
+	nr_w = (int*)(nr_labels + nr_levels);
+	nr_h = nr_w + nr_levels;
+	for (int level = 0; level < nr_levels; level++)
+	{
+		nr_w[level] = level_w[level];
+		nr_h[level] = level_h[level];
+		nr_labels[level] = level_w[level]*level_h[level];
+		labels[level] = (UINT*)(base + off_labels[level]);
+		parent[level] = (UINT*)(base + off_parent[level]);
+		nr_partitions[level] = (UINT*)(base + off_partitions[level]);
+		T[level] = (int*)(base + off_T[level]);
+		histogram[level] = compact[level] ? NULL : (int*)(base + off_hist[level]);
+		histogram16[level] = compact[level] ? (unsigned short*)(base + off_hist[level]) : NULL;
+	}
+	image_bins = (UINT*)(base + off_bins);
+	image_l = (float*)(base + off_planes);
+	image_a = image_l + sz;
+	image_b = image_a + sz;
+#ifdef MEANS
+	L_channel = (float*)(base + off_means);
+	A_channel = L_channel + nr_top;
+	B_channel = A_channel + nr_top;
+#endif
 #ifdef LAB_COLORSPACE
-  bin_cutoff1 = new float[nr_bins];
-  bin_cutoff2 = new float[nr_bins];
-  bin_cutoff3 = new float[nr_bins];
+	bin_cutoff1 = (float*)(base + off_cutoff);
+	bin_cutoff2 = bin_cutoff1 + nr_bins;
+	bin_cutoff3 = bin_cutoff2 + nr_bins;
 #endif
 
+	level_seconds.assign(nr_levels, 0.0);
+	pixel_pass_seconds = 0;
+
 	initialized = true;
+	have_frame = false;
+}
+
+// Block planning
+// Among base blocks of 2..4 pixels per side (the range the method was tuned
+// for) and 2..10 levels, take the layout whose superpixel count is nearest
+// to the request on a log scale. Counts within 1% of each other count as a
+// tie, which goes to more levels (smaller base blocks, finer boundaries)
+// and then to squarer blocks. For 480x320 this reproduces the BSDS presets
+// of the original demo wherever those hit the requested count.
+void SEEDS::plan_blocks(int width, int height, int nr_superpixels, int* seeds_w, int* seeds_h, int* nr_levels)
+{
+	const double tolerance = 0.01;
+	double best_err = -1;
+	int best_skew = 0;
+	*seeds_w = 3; *seeds_h = 4; *nr_levels = 4;
+	if (nr_superpixels < 1) nr_superpixels = 1;
+
+	for (int levels=2; levels<=10; levels++)
+		for (int sw=2; sw<=4; sw++)
+			for (int sh=2; sh<=4; sh++)
+			{
+				int count = ((width/sw) >> (levels-1)) * ((height/sh) >> (levels-1));
+				if (count < 1) continue;
+				double err = fabs(log((double)count/nr_superpixels));
+				int skew = abs(sw-sh);
+				if (best_err < 0 || err < best_err - tolerance ||
+					(err <= best_err + tolerance && (levels > *nr_levels || (levels == *nr_levels && skew < best_skew))))
+				{
+					best_err = err;
+					best_skew = skew;
+					*seeds_w = sw; *seeds_h = sh; *nr_levels = levels;
+				}
+			}
 }
 
 void SEEDS::update_image_ycbcr(UINT* image) {
   
-	seeds_current_level = seeds_nr_levels - 2;
+	reset_iteration_state();
 	
   assign_labels();
   
@@ -223,32 +355,193 @@ void SEEDS::update_image_ycbcr(UINT* image) {
   // convert input image from YCbCr to LAB or HSV
     
     
+#ifdef LAB_COLORSPACE
   unsigned char r, g, b;
   float L, A, B;
   
-  for(int x = 0; x < width; x++)
-    for(int y = 0; y < height; y++)
+  for(int i = 0; i < width*height; i++)
     {
-      int i = y * width + x;
 	  r = image[i] >> 16;
 	  g = (image[i] >> 8) & 0xff;
 	  b = (image[i]) & 0xff;
-#ifdef LAB_COLORSPACE
       image_bins[i] = RGB2LAB_special((int)r, (int)g, (int)b, &L, &A, &B);
       image_l[i] = L/100.0;
       image_a[i] = (A+128.0)/255.0;
       image_b[i] = (B+128.0)/255.0;
+    }
 #endif
 #ifdef HSV_COLORSPACE
-      image_bins[i] = RGB2HSV((int)r, (int)g, (int)b, &L, &A, &B);
-      image_l[i] = L;
-      image_a[i] = A;
-      image_b[i] = B;
+  ColorConverter::ARGB2HSV(image, width*height, image_l, image_a, image_b);
+  for(int i = 0; i < width*height; i++)
+    image_bins[i] = HSV2bin(image_l[i], image_a[i], image_b[i]);
 #endif
-    }
     
   
   compute_histograms();
+  have_frame = true;
+}
+
+// per-image state of iterate(), so that a reused object behaves like a new one
+void SEEDS::reset_iteration_state()
+{
+	seeds_current_level = seeds_nr_levels - 2;
+	nr_pixel_passes = 4;
+	pixel_passes_done = 0;
+	forwardbackward = true;
+}
+
+void SEEDS::update_image_bins(const UINT* bins, const float* c1, const float* c2, const float* c3)
+{
+	reset_iteration_state();
+
+	assign_labels();
+
+	memcpy(image_bins, bins, sizeof(UINT)*width*height);
+	memcpy(image_l, c1, sizeof(float)*width*height);
+	memcpy(image_a, c2, sizeof(float)*width*height);
+	memcpy(image_b, c3, sizeof(float)*width*height);
+
+	compute_histograms();
+	have_frame = true;
+}
+
+// Video
+// A frame differs little from the one before, so the labels of the previous
+// frame are a much better start than the block grid: the histograms are
+// patched where the colour bin of a pixel changed, the base blocks are
+// reattached to the superpixels and iterate() runs from level 0 on.
+void SEEDS::next_frame_bins(const UINT* bins, const float* c1, const float* c2, const float* c3)
+{
+	if (!have_frame)
+	{
+		update_image_bins(bins, c1, c2, c3);
+		return;
+	}
+
+	for (int y=0; y<height; y++)
+		for (int x=0; x<width; x++)
+			set_bin(x, y, bins[y*width+x]);
+	memcpy(image_l, c1, sizeof(float)*width*height);
+	memcpy(image_a, c2, sizeof(float)*width*height);
+	memcpy(image_b, c3, sizeof(float)*width*height);
+
+	snap_to_blocks();
+}
+
+void SEEDS::next_frame_ycbcr(UINT* image)
+{
+	if (!have_frame)
+	{
+		update_image_ycbcr(image);
+		return;
+	}
+
+#ifdef LAB_COLORSPACE
+	for (int y=0; y<height; y++)
+		for (int x=0; x<width; x++)
+		{
+			const int i = y*width + x;
+			float L, A, B;
+			int bin = RGB2LAB_special((int)(image[i] >> 16), (int)((image[i] >> 8) & 0xff), (int)(image[i] & 0xff), &L, &A, &B);
+			image_l[i] = L/100.0;
+			image_a[i] = (A+128.0)/255.0;
+			image_b[i] = (B+128.0)/255.0;
+			set_bin(x, y, bin);
+		}
+#endif
+#ifdef HSV_COLORSPACE
+	ColorConverter::ARGB2HSV(image, width*height, image_l, image_a, image_b);
+	for (int y=0; y<height; y++)
+		for (int x=0; x<width; x++)
+		{
+			const int i = y*width + x;
+			set_bin(x, y, HSV2bin(image_l[i], image_a[i], image_b[i]));
+		}
+#endif
+
+	snap_to_blocks();
+}
+
+// moves a pixel to another colour bin in the histograms iterate() reads:
+// its base block and its superpixel
+void SEEDS::set_bin(int x, int y, UINT bin)
+{
+	const int i = y*width + x;
+	if (image_bins[i] == bin) return;
+	delete_pixel(0, labels[0][i], x, y);
+	delete_pixel(seeds_top_level, labels[seeds_top_level][i], x, y);
+	image_bins[i] = bin;
+	add_pixel(0, labels[0][i], x, y);
+	add_pixel(seeds_top_level, labels[seeds_top_level][i], x, y);
+}
+
+// The pixel passes leave base blocks split between superpixels. Give each
+// block the label of most of its pixels, move the other pixels along, and
+// leave parent[0] and nr_partitions as go_down_one_level() does for level 0.
+void SEEDS::snap_to_blocks()
+{
+	UINT* top = labels[seeds_top_level];
+	for (UINT label=0; label<nr_labels[seeds_top_level]; label++)
+		nr_partitions[seeds_top_level][label] = 0;
+
+	for (int by=0; by<nr_h[0]; by++)
+	{
+		// the last row and column of blocks take the remainder of the image
+		const int y0 = by*seeds_h;
+		const int y1 = by == nr_h[0]-1 ? height : y0+seeds_h;
+		for (int bx=0; bx<nr_w[0]; bx++)
+		{
+			const int x0 = bx*seeds_w;
+			const int x1 = bx == nr_w[0]-1 ? width : x0+seeds_w;
+			UINT label = top[y0*width+x0];
+			bool uniform = true;
+			for (int y=y0; y<y1 && uniform; y++)
+				for (int x=x0; x<x1; x++)
+					if (top[y*width+x] != label) { uniform = false; break; }
+
+			if (!uniform)
+			{
+				// blocks are a few pixels, count the votes in place
+				int best_count = 0;
+				for (int y=y0; y<y1; y++)
+					for (int x=x0; x<x1; x++)
+					{
+						UINT candidate = top[y*width+x];
+						int count = 0;
+						for (int v=y0; v<y1; v++)
+							for (int u=x0; u<x1; u++)
+								count += top[v*width+u] == candidate;
+						if (count > best_count)
+						{
+							best_count = count;
+							label = candidate;
+						}
+					}
+			}
+
+			parent[0][by*nr_w[0]+bx] = label;
+			nr_partitions[seeds_top_level][label]++;
+		}
+	}
+
+	for (int y=0; y<height; y++)
+		for (int x=0; x<width; x++)
+		{
+			const int i = y*width + x;
+			UINT label = parent[0][labels[0][i]];
+			if (top[i] != label)
+			{
+				delete_pixel(seeds_top_level, top[i], x, y);
+				top[i] = label;
+				add_pixel(seeds_top_level, label, x, y);
+			}
+		}
+
+	// the labels are close to converged already: one forward and one
+	// backward pixel pass
+	seeds_current_level = 0;
+	nr_pixel_passes = 2;
+	pixel_passes_done = 0;
 }
 
 
@@ -382,10 +675,8 @@ void SEEDS::compute_histograms(int until_level)
 	// clear histograms
 	for (int level=0; level<seeds_nr_levels; level++)
 	{
-		for (UINT label=0; label<nr_labels[level]; label++)
-		{
-		  memset(histogram[level][label], 0, sizeof(int)*histogram_size);
-		}
+		if (histogram16[level]) memset(histogram16[level], 0, sizeof(unsigned short)*histogram16_stride*nr_labels[level]);
+		else memset(histogram[level], 0, sizeof(int)*histogram_stride*nr_labels[level]);
 		memset(T[level], 0, sizeof(int)*nr_labels[level]);
 	}
 
@@ -453,8 +744,8 @@ void SEEDS::update_blocks(int level, float req_confidence)
 					{
 						// run algorithm as usual
 						delete_block(seeds_top_level, labelA, level, sublabel);
-						float intA = intersection(seeds_top_level, labelA, level, sublabel);
-						float intB = intersection(seeds_top_level, labelB, level, sublabel);
+						float intA, intB;
+						block_intersections(labelA, labelB, level, sublabel, &intA, &intB);
 						float confidence = fabs(intA - intB);
 						// add to label with highest intersection
 						if ((intB > intA) && (confidence > req_confidence))
@@ -473,8 +764,8 @@ void SEEDS::update_blocks(int level, float req_confidence)
 						{
 							// run algorithm as usual
 							delete_block(seeds_top_level, labelA, level, sublabel);
-							float intA = intersection(seeds_top_level, labelA, level, sublabel);
-							float intB = intersection(seeds_top_level, labelB, level, sublabel);
+							float intA, intB;
+							block_intersections(labelA, labelB, level, sublabel, &intA, &intB);
 							float confidence = fabs(intA - intB);
 							// add to label with highest intersection
 							if ((intB > intA) && (confidence > req_confidence))
@@ -498,8 +789,8 @@ void SEEDS::update_blocks(int level, float req_confidence)
 					{
 						// run algorithm as usual
 						delete_block(seeds_top_level, labelB, level, sublabel);
-						float intA = intersection(seeds_top_level, labelA, level, sublabel);
-						float intB = intersection(seeds_top_level, labelB, level, sublabel);
+						float intA, intB;
+						block_intersections(labelA, labelB, level, sublabel, &intA, &intB);
 						float confidence = fabs(intA - intB);
 						if ((intA > intB) && (confidence > req_confidence))
 						{
@@ -517,8 +808,8 @@ void SEEDS::update_blocks(int level, float req_confidence)
 						{
 							// run algorithm as usual
 							delete_block(seeds_top_level, labelB, level, sublabel);
-							float intA = intersection(seeds_top_level, labelA, level, sublabel);
-							float intB = intersection(seeds_top_level, labelB, level, sublabel);
+							float intA, intB;
+							block_intersections(labelA, labelB, level, sublabel, &intA, &intB);
 							float confidence = fabs(intA - intB);
 							if ((intA > intB) && (confidence > req_confidence))
 							{
@@ -570,8 +861,8 @@ void SEEDS::update_blocks(int level, float req_confidence)
 					{
 						// run algorithm as usual
 						delete_block(seeds_top_level, labelA, level, sublabel);
-						float intA = intersection(seeds_top_level, labelA, level, sublabel);
-						float intB = intersection(seeds_top_level, labelB, level, sublabel);
+						float intA, intB;
+						block_intersections(labelA, labelB, level, sublabel, &intA, &intB);
 						float confidence = fabs(intA - intB);
 						// add to label with highest intersection
 						if ((intB > intA) && (confidence > req_confidence))
@@ -591,8 +882,8 @@ void SEEDS::update_blocks(int level, float req_confidence)
 						{
 							// run algorithm as usual
 							delete_block(seeds_top_level, labelA, level, sublabel);
-							float intA = intersection(seeds_top_level, labelA, level, sublabel);
-							float intB = intersection(seeds_top_level, labelB, level, sublabel);
+							float intA, intB;
+							block_intersections(labelA, labelB, level, sublabel, &intA, &intB);
 							float confidence = fabs(intA - intB);
 							// add to label with highest intersection
 							if ((intB > intA) && (confidence > req_confidence))
@@ -617,8 +908,8 @@ void SEEDS::update_blocks(int level, float req_confidence)
 					{
 						// run algorithm as usual
 						delete_block(seeds_top_level, labelB, level, sublabel);
-						float intA = intersection(seeds_top_level, labelA, level, sublabel);
-						float intB = intersection(seeds_top_level, labelB, level, sublabel);
+						float intA, intB;
+						block_intersections(labelA, labelB, level, sublabel, &intA, &intB);
 						float confidence = fabs(intA - intB);
 						if ((intA > intB) && (confidence > req_confidence))
 						{
@@ -636,8 +927,8 @@ void SEEDS::update_blocks(int level, float req_confidence)
 						{
 							// run algorithm as usual
 							delete_block(seeds_top_level, labelB, level, sublabel);
-							float intA = intersection(seeds_top_level, labelA, level, sublabel);
-							float intB = intersection(seeds_top_level, labelB, level, sublabel);
+							float intA, intB;
+							block_intersections(labelA, labelB, level, sublabel, &intA, &intB);
 							float confidence = fabs(intA - intB);
 							if ((intA > intB) && (confidence > req_confidence))
 							{
@@ -883,37 +1174,7 @@ void SEEDS::update_pixels()
 
 	}
 
-	// update border pixels
-	for (int x=0; x<width; x++)
-	{
-		labelA = labels[seeds_top_level][x];
-		labelB = labels[seeds_top_level][width+x];
-		if (labelA != labelB)
-		{
-				update(seeds_top_level, labelB, x, 0);	
-		}
-		labelA = labels[seeds_top_level][(height-1)*width + x];
-		labelB = labels[seeds_top_level][(height-2)*width + x];
-		if (labelA != labelB)
-		{
-				update(seeds_top_level, labelB, x, height-1);			
-		}
-	}
-	for (int y=0; y<height; y++)
-	{
-		labelA = labels[seeds_top_level][y*width];
-		labelB = labels[seeds_top_level][y*width+1];
-		if (labelA != labelB)
-		{
-				update(seeds_top_level, labelB, 0, y);	
-		}
-		labelA = labels[seeds_top_level][y*width + width - 1];
-		labelB = labels[seeds_top_level][y*width + width - 2];
-		if (labelA != labelB)
-		{
-				update(seeds_top_level, labelB, width-1, y);			
-		}
-	}
+	update_border_pixels();
 }
 
 
@@ -1111,7 +1372,16 @@ void SEEDS::update_pixels_means()
 
 	}
 
-	// update border pixels
+	update_border_pixels();
+}
+
+
+// update border pixels
+void SEEDS::update_border_pixels()
+{
+	int labelA;
+	int labelB;
+
 	for (int x=0; x<width; x++)
 	{
 		labelA = labels[seeds_top_level][x];
@@ -1145,6 +1415,217 @@ void SEEDS::update_pixels_means()
 }
 
 
+// Parallel Border Updating Algorithm
+// The same decisions as update_pixels() / update_pixels_means(), but the
+// rows (and columns) are visited in interleaved stripes instead of raster
+// order. A horizontal step at row y reads rows y-1..y+1 and writes row y,
+// so all rows of one parity can run at once. A vertical step at column x
+// reads columns x-1..x+2 (fourbythree() looks two columns to the right)
+// and writes column x, so the columns need a stride of 3. The histograms,
+// sizes and colour sums are frozen within a phase and the buffered moves
+// are applied in row (column) order afterwards, so the labels do not
+// depend on the number of threads.
+void SEEDS::update_pixels_parallel(bool means)
+{
+	const bool forward = forwardbackward;
+	forwardbackward = !forwardbackward;
+
+	vector< vector<pixel_move> >& moves = move_buffers;
+	moves.resize(nr_threads);
+
+	// horizontal bidirectional: rows 1, 3, 5, ... then rows 2, 4, 6, ...
+	for (int first=1; first<=2; first++)
+	{
+		const int n = height-2 >= first ? (height-2-first)/2 + 1 : 0;
+		#pragma omp parallel for num_threads(nr_threads) schedule(static)
+		for (int c=0; c<nr_threads; c++)
+		{
+			moves[c].clear();
+			for (int k=c*n/nr_threads; k<(c+1)*n/nr_threads; k++)
+				update_row(first + 2*k, forward, means, moves[c]);
+		}
+		apply_moves(moves);
+	}
+
+	// vertical bidirectional: columns 1, 4, 7, ... then 2, 5, 8, ... then 3, 6, 9, ...
+	for (int first=1; first<=3; first++)
+	{
+		const int n = width-2 >= first ? (width-2-first)/3 + 1 : 0;
+		#pragma omp parallel for num_threads(nr_threads) schedule(static)
+		for (int c=0; c<nr_threads; c++)
+		{
+			moves[c].clear();
+			for (int k=c*n/nr_threads; k<(c+1)*n/nr_threads; k++)
+				update_column(first + 3*k, forward, means, moves[c]);
+		}
+		apply_moves(moves);
+	}
+
+	update_border_pixels();
+}
+
+void SEEDS::update_row(int y, bool forward, bool means, vector<pixel_move>& moves)
+{
+	const UINT* lab = labels[seeds_top_level];
+	int priorA=0;
+	int priorB=0;
+
+	for (int x=1; x<width-2; x++)
+	{
+		int a11 = lab[(y-1)*width+(x-1)];
+		int a12 = lab[(y-1)*width+(x)];
+		int a13 = lab[(y-1)*width+(x+1)];
+		int a14 = lab[(y-1)*width+(x+2)];
+		int a21 = lab[(y)*width+(x-1)];
+		int a22 = lab[(y)*width+(x)];
+		int a23 = lab[(y)*width+(x+1)];
+		int a24 = lab[(y)*width+(x+2)];
+		int a31 = lab[(y+1)*width+(x-1)];
+		int a32 = lab[(y+1)*width+(x)];
+		int a33 = lab[(y+1)*width+(x+1)];
+		int a34 = lab[(y+1)*width+(x+2)];
+
+		int labelA = a22;
+		int labelB = a23;
+		if (labelA == labelB) continue;
+
+		if (forward)
+		{
+			if (check_split(a11, a12, a13, a21, a22, a23, a31, a32, a33, true, true)) continue;
+			#ifdef PRIOR
+			priorA = threebyfour(x,y,labelA);
+			priorB = threebyfour(x,y,labelB);
+			#endif
+
+			if (prefers_second(y*width+x, labelA, labelB, priorA, priorB, means))
+			{
+				move_pixel(labelB, x, y, moves);
+			}
+			else if (!check_split(a12, a13, a14, a22, a23, a24, a32, a33, a34, true, false) &&
+				prefers_second(y*width+x+1, labelB, labelA, priorB, priorA, means))
+			{
+				move_pixel(labelA, x+1, y, moves);
+				x++;
+			}
+		}
+		else
+		{
+			if (check_split(a12, a13, a14, a22, a23, a24, a32, a33, a34, true, false)) continue;
+			#ifdef PRIOR
+			priorA = threebyfour(x,y,labelA);
+			priorB = threebyfour(x,y,labelB);
+			#endif
+
+			if (prefers_second(y*width+x+1, labelB, labelA, priorB, priorA, means))
+			{
+				move_pixel(labelA, x+1, y, moves);
+				x++;
+			}
+			else if (!check_split(a11, a12, a13, a21, a22, a23, a31, a32, a33, true, true) &&
+				prefers_second(y*width+x, labelA, labelB, priorA, priorB, means))
+			{
+				move_pixel(labelB, x, y, moves);
+			}
+		}
+	}
+}
+
+void SEEDS::update_column(int x, bool forward, bool means, vector<pixel_move>& moves)
+{
+	const UINT* lab = labels[seeds_top_level];
+	int priorA=0;
+	int priorB=0;
+
+	for (int y=1; y<height-2; y++)
+	{
+		int a11 = lab[(y-1)*width+(x-1)];
+		int a12 = lab[(y-1)*width+(x)];
+		int a13 = lab[(y-1)*width+(x+1)];
+		int a21 = lab[(y)*width+(x-1)];
+		int a22 = lab[(y)*width+(x)];
+		int a23 = lab[(y)*width+(x+1)];
+		int a31 = lab[(y+1)*width+(x-1)];
+		int a32 = lab[(y+1)*width+(x)];
+		int a33 = lab[(y+1)*width+(x+1)];
+		int a41 = lab[(y+2)*width+(x-1)];
+		int a42 = lab[(y+2)*width+(x)];
+		int a43 = lab[(y+2)*width+(x+1)];
+
+		int labelA = a22;
+		int labelB = a32;
+		if (labelA == labelB) continue;
+
+		if (forward)
+		{
+			if (check_split(a11, a12, a13, a21, a22, a23, a31, a32, a33, false, true)) continue;
+			#ifdef PRIOR
+			priorA = fourbythree(x,y,labelA);
+			priorB = fourbythree(x,y,labelB);
+			#endif
+
+			if (prefers_second(y*width+x, labelA, labelB, priorA, priorB, means))
+			{
+				move_pixel(labelB, x, y, moves);
+			}
+			else if (!check_split(a21, a22, a23, a31, a32, a33, a41, a42, a43, false, false) &&
+				prefers_second((y+1)*width+x, labelB, labelA, priorB, priorA, means))
+			{
+				move_pixel(labelA, x, y+1, moves);
+				y++;
+			}
+		}
+		else
+		{
+			if (check_split(a21, a22, a23, a31, a32, a33, a41, a42, a43, false, false)) continue;
+			#ifdef PRIOR
+			priorA = fourbythree(x,y,labelA);
+			priorB = fourbythree(x,y,labelB);
+			#endif
+
+			if (prefers_second((y+1)*width+x, labelB, labelA, priorB, priorA, means))
+			{
+				move_pixel(labelA, x, y+1, moves);
+				y++;
+			}
+			else if (!check_split(a11, a12, a13, a21, a22, a23, a31, a32, a33, false, true) &&
+				prefers_second(y*width+x, labelA, labelB, priorA, priorB, means))
+			{
+				move_pixel(labelB, x, y, moves);
+			}
+		}
+	}
+}
+
+// true if pixel i fits label2 better than label1
+bool SEEDS::prefers_second(int i, int label1, int label2, int prior1, int prior2, bool means)
+{
+	if (means) return probability_means(image_l[i], image_a[i], image_b[i], label1, label2, prior1, prior2);
+	return probability(image_bins[i], label1, label2, prior1, prior2);
+}
+
+void SEEDS::move_pixel(int label_new, int x, int y, vector<pixel_move>& moves)
+{
+	pixel_move m;
+	m.x = x;
+	m.y = y;
+	m.from = labels[seeds_top_level][y*width+x];
+	m.to = label_new;
+	labels[seeds_top_level][y*width+x] = label_new;
+	moves.push_back(m);
+}
+
+void SEEDS::apply_moves(const vector< vector<pixel_move> >& moves)
+{
+	for (size_t c=0; c<moves.size(); c++)
+		for (size_t k=0; k<moves[c].size(); k++)
+		{
+			const pixel_move& m = moves[c][k];
+			delete_pixel_m(seeds_top_level, m.from, m.x, m.y);
+			add_pixel_m(seeds_top_level, m.to, m.x, m.y);
+		}
+}
+
+
 
 void SEEDS::update(int level, int label_new, int x, int y)
 {
@@ -1156,13 +1637,14 @@ void SEEDS::update(int level, int label_new, int x, int y)
 
 void SEEDS::add_pixel(int level, int label, int x, int y)
 {
-	histogram[level][label][image_bins[y*width+x]]++;
+	if (histogram16[level]) hist16(level, label)[image_bins[y*width+x]]++;
+	else hist(level, label)[image_bins[y*width+x]]++;
 	T[level][label]++;
 }
 
 void SEEDS::add_pixel_m(int level, int label, int x, int y)
 {
-	histogram[level][label][image_bins[y*width+x]]++;
+	hist(level, label)[image_bins[y*width+x]]++; // top level, never compact
 	T[level][label]++;
 
 #ifdef MEANS
@@ -1174,13 +1656,14 @@ void SEEDS::add_pixel_m(int level, int label, int x, int y)
 
 void SEEDS::delete_pixel(int level, int label, int x, int y)
 {
-	histogram[level][label][image_bins[y*width+x]]--;
+	if (histogram16[level]) hist16(level, label)[image_bins[y*width+x]]--;
+	else hist(level, label)[image_bins[y*width+x]]--;
 	T[level][label]--;
 }
 
 void SEEDS::delete_pixel_m(int level, int label, int x, int y)
 {
-	histogram[level][label][image_bins[y*width+x]]--;
+	hist(level, label)[image_bins[y*width+x]]--; // top level, never compact
 	T[level][label]--;
 	
 #ifdef MEANS
@@ -1191,15 +1674,34 @@ void SEEDS::delete_pixel_m(int level, int label, int x, int y)
 }
 
 
-void SEEDS::add_block(int level, int label, int sublevel, int sublabel)
+// adds (sign 1) or subtracts (sign -1) the histogram of a sub-block
+template<typename D, typename S>
+static inline void combine_histograms(D* dst, const S* src, int n, int sign)
 {
-	parent[sublevel][sublabel] = label;
+	if (sign > 0) for (int i=0; i<n; i++) dst[i] += src[i];
+	else for (int i=0; i<n; i++) dst[i] -= src[i];
+}
 
-	for (int n=0; n<histogram_size; n++)
+void SEEDS::combine_blocks(int level, int label, int sublevel, int sublabel, int sign)
+{
+	if (histogram16[level])
 	{
-		histogram[level][label][n] += histogram[sublevel][sublabel][n];
+		if (histogram16[sublevel]) combine_histograms(hist16(level, label), hist16(sublevel, sublabel), histogram_size, sign);
+		else combine_histograms(hist16(level, label), hist(sublevel, sublabel), histogram_size, sign);
 	}
-	T[level][label] += T[sublevel][sublabel];
+	else
+	{
+		if (histogram16[sublevel]) combine_histograms(hist(level, label), hist16(sublevel, sublabel), histogram_size, sign);
+		else combine_histograms(hist(level, label), hist(sublevel, sublabel), histogram_size, sign);
+	}
+	T[level][label] += sign*T[sublevel][sublabel];
+}
+
+void SEEDS::add_block(int level, int label, int sublevel, int sublabel)
+{
+	parent[sublevel][sublabel] = label;
+
+	combine_blocks(level, label, sublevel, sublabel, 1);
 
 	nr_partitions[level][label]++;
 }
@@ -1210,11 +1712,7 @@ void SEEDS::delete_block(int level, int label, int sublevel, int sublabel)
 {
 	parent[sublevel][sublabel] = -1;
 
-	for (int n=0; n<histogram_size; n++)
-	{
-		histogram[level][label][n] -= histogram[sublevel][sublabel][n];
-	}
-	T[level][label] -= T[sublevel][sublabel];
+	combine_blocks(level, label, sublevel, sublabel, -1);
 
 	nr_partitions[level][label]--;
 }
@@ -1234,8 +1732,8 @@ void SEEDS::update_labels(int level)
 
 bool SEEDS::probability(int color, int label1, int label2, int prior1, int prior2)
 {
-	float P_label1 = (float)histogram[seeds_top_level][label1][color] / (float)T[seeds_top_level][label1];
-	float P_label2 = (float)histogram[seeds_top_level][label2][color] / (float)T[seeds_top_level][label2];
+	float P_label1 = (float)hist(seeds_top_level, label1)[color] / (float)T[seeds_top_level][label1];
+	float P_label2 = (float)hist(seeds_top_level, label2)[color] / (float)T[seeds_top_level][label2];
 
 	#ifdef PRIOR
 		P_label1 *= (float) prior1;
@@ -1300,34 +1798,9 @@ void SEEDS::LAB2RGB(float L, float a, float b, int* R, int* G, int* B)
 
 int SEEDS::RGB2LAB(const int& r, const int& g, const int& b, float* lval, float* aval, float* bval)
 {
-	float xVal = 0.412453 * r + 0.357580 * g + 0.180423 * b;
-	float yVal = 0.212671 * r + 0.715160 * g + 0.072169 * b;
-	float zVal = 0.019334 * r + 0.119193 * g + 0.950227 * b;
-
-	xVal /= (255.0 * 0.950456);
-	yVal /=  255.0;
-	zVal /= (255.0 * 1.088754);
-
-	float fY, fZ, fX;
-	float lVal, aVal, bVal;
-	float T = 0.008856;
-
-	bool XT = (xVal > T);
-	bool YT = (yVal > T);
-	bool ZT = (zVal > T);
-
-	fX = XT * pow(xVal,1.0/3.0) + (!XT) * (7.787 * xVal + 16.0/116.0);
-
-	// Compute L
-	float Y3 = pow(yVal,1.0/3.0); 
-	fY = YT*Y3 + (!YT)*(7.787*yVal + 16.0/116.0);
-	lVal  = YT * (116 * Y3 - 16.0) + (!YT)*(903.3*yVal);
-
-	fZ = ZT*pow(zVal,1.0/3.0) + (!ZT)*(7.787*zVal + 16.0/116.0);
-
-	// Compute a and b
-	aVal = 500 * (fX - fY);
-	bVal = 200 * (fY - fZ);
+	double L, A, B;
+	ColorConverter::RGB2Lab(r, g, b, L, A, B);
+	float lVal = L, aVal = A, bVal = B;
 
 	*lval = lVal;
 	*aval = aVal;
@@ -1338,61 +1811,9 @@ int SEEDS::RGB2LAB(const int& r, const int& g, const int& b, float* lval, float*
 
 
 
-int SEEDS::RGB2HSV(const int& r, const int& g, const int& b, float* hval, float* sval, float* vval)
+int SEEDS::HSV2bin(float H, float S, float V)
 {
-	float r_ = r / 256.0;
-	float g_ = g / 256.0;
-	float b_ = b / 256.0;
-
-    float min_rgb = min(r_, min(g_, b_));
-    float max_rgb = max(r_, max(g_, b_));
-    float V = max_rgb;
-	float H = 0.0;
-	float S = 0.0;
-
-    float delta = max_rgb - min_rgb;
-	
-	if ((delta > 0.0) && (max_rgb > 0.0))
-	{
-		S = delta / max_rgb;
-	    if (max_rgb == r_)
-	        H = (g_ - b_) / delta;
-    	else if (max_rgb == g_)
-	        H = 2 + (b_ - r_) / delta;
-	    else
-	        H = 4 + (r_ - g_) / delta;
-	}
-
-    H /= 6;
-
-	/*float V = max(r_,max(g_,b_));
-	float S = 0.0;
-	if (V != 0.0) S = (V - min(r_, min(g_,b_)))/V;
-	float H = 0.0;
-	if (S != 0.0)
-	{
-		if (V == r_)
-			H = ((g_ - b_)/6.0)/S;
-		else if (V == g_)
-			H = 1.0/2.0 + ((b_-r_)/6.0)/S;
-		else
-			H = 2.0/3.0 + ((r_-g_)/6.0)/S;
-	}*/
-
-	if (H<0.0) H += 1.0;
-
-	*hval = H;
-	*sval = S;
-	*vval = V;
-
-	int hbin = int(H * nr_bins);
-	int sbin = int(S * nr_bins);
-	int vbin = int(V * nr_bins);
-	if(sbin == nr_bins) --sbin; //S can be equal to 1.0
-
-	//printf("%d %d %d -- %f %f %f -- bins %d %d %d\n", r, g, b, H, S, V, hbin, sbin, vbin);
-
-	return hbin + nr_bins*(sbin + nr_bins*vbin);
+	return ColorConverter::HSV2Bin(H, S, V, nr_bins);
 }
 
 int SEEDS::LAB2bin(float l, float a, float b)
@@ -1415,34 +1836,9 @@ int SEEDS::LAB2bin(float l, float a, float b)
 
 int SEEDS::RGB2LAB_special(int r, int g, int b, float* lval, float* aval, float* bval)
 {
-	float xVal = 0.412453 * r + 0.357580 * g + 0.180423 * b;
-	float yVal = 0.212671 * r + 0.715160 * g + 0.072169 * b;
-	float zVal = 0.019334 * r + 0.119193 * g + 0.950227 * b;
-
-	xVal /= (255.0 * 0.950456);
-	yVal /=  255.0;
-	zVal /= (255.0 * 1.088754);
-
-	float fY, fZ, fX;
-	float lVal, aVal, bVal;
-	float T = 0.008856;
-
-	bool XT = (xVal > T);
-	bool YT = (yVal > T);
-	bool ZT = (zVal > T);
-
-	fX = XT * pow(xVal,1.0/3.0) + (!XT) * (7.787 * xVal + 16/116);
-
-	// Compute L
-	float Y3 = pow(yVal,1.0/3.0); 
-	fY = YT*Y3 + (!YT)*(7.787*yVal + 16/116);
-	lVal  = YT * (116 * Y3 - 16.0) + (!YT)*(903.3*yVal);
-
-	fZ = ZT*pow(zVal,1.0/3.0) + (!ZT)*(7.787*zVal + 16/116);
-
-	// Compute a and b
-	aVal = 500 * (fX - fY);
-	bVal = 200 * (fY - fZ);
+	double L, A, B;
+	ColorConverter::RGB2Lab(r, g, b, L, A, B);
+	float lVal = L, aVal = A, bVal = B;
 
 	*lval = lVal;
 	*aval = aVal;
@@ -1468,35 +1864,9 @@ int SEEDS::RGB2LAB_special(int r, int g, int b, float* lval, float* aval, float*
 
 int SEEDS::RGB2LAB_special(int r, int g, int b, int* bin_l, int* bin_a, int* bin_b)
 {
-	float xVal = 0.412453 * r + 0.357580 * g + 0.180423 * b;
-	float yVal = 0.212671 * r + 0.715160 * g + 0.072169 * b;
-	float zVal = 0.019334 * r + 0.119193 * g + 0.950227 * b;
-
-	xVal /= (255.0 * 0.950456);
-	yVal /=  255.0;
-	zVal /= (255.0 * 1.088754);
-
-	float fY, fZ, fX;
-	float lVal, aVal, bVal;
-	float T = 0.008856;
-
-	bool XT = (xVal > T);
-	bool YT = (yVal > T);
-	bool ZT = (zVal > T);
-
-	fX = XT * pow(xVal,1.0/3.0) + (!XT) * (7.787 * xVal + 16/116);
-
-	// Compute L
-	float Y3 = pow(yVal,1.0/3.0); 
-	fY = YT*Y3 + (!YT)*(7.787*yVal + 16/116);
-	lVal  = YT * (116 * Y3 - 16.0) + (!YT)*(903.3*yVal);
-
-	fZ = ZT*pow(zVal,1.0/3.0) + (!ZT)*(7.787*zVal + 16/116);
-
-	// Compute a and b
-	aVal = 500 * (fX - fY);
-
-	bVal = 200 * (fY - fZ);
+	double L, A, B;
+	ColorConverter::RGB2Lab(r, g, b, L, A, B);
+	float lVal = L, aVal = A, bVal = B;
 
 	//*lval = lVal;
 	//*aval = aVal;
@@ -1586,25 +1956,123 @@ int SEEDS::fourbythree(int x, int y, UINT label)
 }
 
 
-float SEEDS::intersection(int level1, int label1, int level2, int label2)
+#ifdef SEEDS_SSE2
+// 4 bins in 32-bit lanes
+static inline __m128i load_bins(const int* h) { return _mm_loadu_si128((const __m128i*)h); }
+static inline __m128i load_bins(const unsigned short* h) { return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)h), _mm_setzero_si128()); }
+
+// low 32 bits of the lane products, as the scalar int multiply
+static inline __m128i mul_lanes(__m128i a, __m128i b)
+{
+#ifdef SEEDS_SSE41
+	return _mm_mullo_epi32(a, b);
+#else
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+#endif
+}
+
+static inline int sum_lanes(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,3,2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2,3,0,1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+// one step of intersect_histograms on 4 bins: h1 goes to sum1 where
+// h1/count1 < h2/count2, h2 to sum2 elsewhere
+static inline void intersect_lanes(__m128i h1, __m128i count1, __m128i h2, __m128i count2, __m128i& sum1, __m128i& sum2)
+{
+	__m128i first = _mm_cmplt_epi32(mul_lanes(h1, count2), mul_lanes(h2, count1));
+	sum1 = _mm_add_epi32(sum1, _mm_and_si128(first, h1));
+	sum2 = _mm_add_epi32(sum2, _mm_andnot_si128(first, h2));
+}
+#endif
+
+//intersection of 2 histograms: take the smaller value in each bin
+//and return the sum. The bins are compared as h1*count2 < h2*count1,
+//so the result is exact and the same with and without SIMD.
+template<typename A, typename B>
+static inline float intersect_histograms(const A* h1, const int count1, const B* h2, const int count2, int n)
 {
-	//intersection of 2 histograms: take the smaller value in each bin
-	//and return the sum
     int sum1 = 0, sum2=0;
-    int* h1 = histogram[level1][label1];
-    int* h2 = histogram[level2][label2];
+	int i = 0;
+#ifdef SEEDS_SSE2
+	const __m128i c1 = _mm_set1_epi32(count1), c2 = _mm_set1_epi32(count2);
+	__m128i s1 = _mm_setzero_si128(), s2 = _mm_setzero_si128();
+	for ( ; i+4 <= n; i += 4)
+		intersect_lanes(load_bins(h1+i), c1, load_bins(h2+i), c2, s1, s2);
+	sum1 = sum_lanes(s1);
+	sum2 = sum_lanes(s2);
+#endif
+	for ( ; i<n; i++)
+	{
+		if(h1[i] * count2 < h2[i] * count1) sum1+=h1[i];
+		else sum2+=h2[i];
+	}
+
+	return ((float)sum1)/(float)count1 + ((float)sum2)/(float)count2;
+}
+
+// intersections of one block histogram h with those of the two superpixels
+// it may belong to, reading h once
+template<typename S>
+static inline void intersect_histograms(const int* hA, const int countA, const int* hB, const int countB,
+	const S* h, const int count, int n, float* intA, float* intB)
+{
+	int sumA1 = 0, sumA2 = 0, sumB1 = 0, sumB2 = 0;
+	int i = 0;
+#ifdef SEEDS_SSE2
+	const __m128i cA = _mm_set1_epi32(countA), cB = _mm_set1_epi32(countB), c = _mm_set1_epi32(count);
+	__m128i sA1 = _mm_setzero_si128(), sA2 = _mm_setzero_si128(), sB1 = _mm_setzero_si128(), sB2 = _mm_setzero_si128();
+	for ( ; i+4 <= n; i += 4)
+	{
+		__m128i b = load_bins(h+i);
+		intersect_lanes(load_bins(hA+i), cA, b, c, sA1, sA2);
+		intersect_lanes(load_bins(hB+i), cB, b, c, sB1, sB2);
+	}
+	sumA1 = sum_lanes(sA1); sumA2 = sum_lanes(sA2);
+	sumB1 = sum_lanes(sB1); sumB2 = sum_lanes(sB2);
+#endif
+	for ( ; i<n; i++)
+	{
+		if (hA[i] * count < h[i] * countA) sumA1 += hA[i];
+		else sumA2 += h[i];
+		if (hB[i] * count < h[i] * countB) sumB1 += hB[i];
+		else sumB2 += h[i];
+	}
+
+	*intA = ((float)sumA1)/(float)countA + ((float)sumA2)/(float)count;
+	*intB = ((float)sumB1)/(float)countB + ((float)sumB2)/(float)count;
+}
+
+float SEEDS::intersection(int level1, int label1, int level2, int label2)
+{
     const int count1 = T[level1][label1];
     const int count2 = T[level2][label2];
-	
-	for (int n=0; n<histogram_size; n++)
+	if (histogram16[level1])
 	{
-		if(*h1 * count2 < *h2 * count1) sum1+=*h1;
-		else sum2+=*h2;
-		++h1;
-		++h2;
+		if (histogram16[level2]) return intersect_histograms(hist16(level1, label1), count1, hist16(level2, label2), count2, histogram_size);
+		return intersect_histograms(hist16(level1, label1), count1, hist(level2, label2), count2, histogram_size);
 	}
+	if (histogram16[level2]) return intersect_histograms(hist(level1, label1), count1, hist16(level2, label2), count2, histogram_size);
+	return intersect_histograms(hist(level1, label1), count1, hist(level2, label2), count2, histogram_size);
+}
 
-	return ((float)sum1)/(float)count1 + ((float)sum2)/(float)count2;
+// scores of moving a block to superpixel labelA or labelB, the same as
+// intersection(seeds_top_level, labelA/B, level, sublabel)
+void SEEDS::block_intersections(int labelA, int labelB, int level, int sublabel, float* intA, float* intB)
+{
+	const int countA = T[seeds_top_level][labelA];
+	const int countB = T[seeds_top_level][labelB];
+	const int count = T[level][sublabel];
+	if (histogram16[level])
+		intersect_histograms(hist(seeds_top_level, labelA), countA, hist(seeds_top_level, labelB), countB,
+			hist16(level, sublabel), count, histogram_size, intA, intB);
+	else
+		intersect_histograms(hist(seeds_top_level, labelA), countA, hist(seeds_top_level, labelB), countB,
+			hist(level, sublabel), count, histogram_size, intA, intB);
 }
 
 
@@ -1686,7 +2154,10 @@ void SEEDS::SaveLabels_Text(string filename)
 
 void SEEDS::compute_mean_map()
 {
-	means = new UINT[width*height];
+	if (!means) means = new UINT[width*height];
+#ifdef MEANS
+	if (pixel_passes_done == 0) compute_means(); // iterate() stopped before the pixel passes
+#endif
 
 	for (int i=0; i<width*height; i++)
 	{
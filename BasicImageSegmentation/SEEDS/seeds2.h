@@ -16,6 +16,7 @@
 #define _SEEDS_H_INCLUDED_
 
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -32,14 +33,59 @@ public:
 	//the number of superpixels is:
 	// (image_width/seeds_w/(2^(nr_levels-1))) * (image_height/seeds_h/(2^(nr_levels-1)))
 	void initialize(int seeds_w, int seeds_h, int nr_levels);
+
+	// choose seeds_w, seeds_h (2..4) and nr_levels so that the number of
+	// superpixels above is as close as possible to nr_superpixels
+	static void plan_blocks(int width, int height, int nr_superpixels, int* seeds_w, int* seeds_h, int* nr_levels);
 	
 	//set a new image in YCbCr format
 	//image must have the same size as in the constructor was given
 	void update_image_ycbcr(UINT* image);
+
+	//set a new image from precomputed histogram bins and colour planes, in
+	//the colour space seeds2.cpp is compiled for (e.g. from a FeatureCache)
+	void update_image_bins(const UINT* bins, const float* c1, const float* c2, const float* c3);
+
+	// start over on another image of the same size, reusing every buffer;
+	// the result is the same as from a fresh SEEDS with the same initialize()
+	void reset(UINT* image) { update_image_ycbcr(image); }
+	void reset(const UINT* bins, const float* c1, const float* c2, const float* c3) { update_image_bins(bins, c1, c2, c3); }
+	int get_width() const { return width; }
+	int get_height() const { return height; }
+
+	// video: take the next frame of the same size and let iterate() continue
+	// from the current labels instead of the block grid. Pixels that changed
+	// histogram bin are moved in the histograms, the base blocks take the
+	// label of most of their pixels, and iterate() then runs the block update
+	// of level 0 and two pixel passes only. The first frame (or one after
+	// initialize()) is segmented from scratch.
+	void next_frame_ycbcr(UINT* image);
+	void next_frame_bins(const UINT* bins, const float* c1, const float* c2, const float* c3);
 	
 	// go through iterations
 	void iterate();
 
+	// anytime version: stop before a step (one block level or one pixel
+	// pass) that would take more than max_seconds in total, or after
+	// max_steps steps; a negative value means no limit. A step is expected
+	// to take as long as it did the last time it ran. Before that, a block
+	// level is estimated from the level above and a pixel pass from level 0;
+	// the top level has no estimate and only starts as the first step of a
+	// call, which it may overrun. The labels are a valid
+	// partition after every step, and each step only improves it. Returns
+	// true when all steps are done; otherwise a further call continues.
+	bool iterate(double max_seconds, int max_steps = -1);
+
+	// wall time of the last run of each step: the block update of a level
+	// (0 .. nr_levels-2) and a pixel pass (the first one includes the means);
+	// 0 before the step has run
+	double get_level_seconds(int level) const { return level_seconds[level]; }
+	double get_pixel_pass_seconds() const { return pixel_pass_seconds; }
+
+	// threads for the pixel-level border updates; 1 keeps the serial raster
+	// scan, more use the striped scan of update_pixels_parallel()
+	void set_num_threads(int n) { nr_threads = n < 1 ? 1 : n; }
+
 	UINT* get_labels() { return labels[seeds_top_level]; }
 	// output labels
 	UINT** labels;	 //[level][y * width + x]
@@ -56,6 +102,7 @@ private:
 	void deinitialize();
 	
 	bool initialized;
+	char* arena; //all level arrays and image planes, allocated in initialize()
 
 	// seeds	
 	int seeds_w;
@@ -84,10 +131,14 @@ private:
 	void assign_labels();
 	void compute_histograms(int until_level = -1);
 	void compute_means();
+	void reset_iteration_state();
+	bool have_frame; //labels and histograms of a previous frame are valid
+	void set_bin(int x, int y, UINT bin);
+	void snap_to_blocks();
 	//void lab_get_histogram_cutoff_values(const Image& image);
 	
 	// color conversion and histograms
-	int RGB2HSV(const int& r, const int& g, const int& b, float* hval, float* sval, float* vval);
+	int HSV2bin(float h, float s, float v);
 	int RGB2LAB(const int& r, const int& g, const int& b, float* lval, float* aval, float* bval);
 	int LAB2bin(float l, float a, float b);
 	int RGB2LAB_special(int r, int g, int b, float* lval, float* aval, float* bval);
@@ -95,7 +146,17 @@ private:
 	void LAB2RGB(float L, float a, float b, int* R, int* G, int* B);
 
 	int histogram_size; //= nr_bins ^ 3 (3 channels)
-	int*** histogram; //[level][label][j < histogram_size]
+	// histograms of one level are contiguous, label after label, each padded
+	// to a cache line: [level][label*stride + j], j < histogram_size. Levels
+	// whose blocks never exceed 65535 pixels use 16-bit counts (histogram16),
+	// the others 32-bit counts (histogram); the unused pointer is NULL.
+	int** histogram;
+	unsigned short** histogram16;
+	int histogram_stride;
+	int histogram16_stride;
+	int* hist(int level, int label) { return histogram[level] + label*histogram_stride; }
+	unsigned short* hist16(int level, int label) { return histogram16[level] + label*histogram16_stride; }
+	void combine_blocks(int level, int label, int sublevel, int sublabel, int sign);
 	
 
   void update(int level, int label_new, int x, int y);
@@ -120,11 +181,32 @@ private:
 	// block updating
 	void update_blocks(int level, float req_confidence = 0.0);
 	float intersection(int level1, int label1, int level2, int label2);
+	void block_intersections(int labelA, int labelB, int level, int sublabel, float* intA, float* intB);
 
 	// border updating
 	void update_pixels();
 	void update_pixels_means();
+	void update_border_pixels();
 	bool forwardbackward;
+	int nr_pixel_passes;
+	int pixel_passes_done;
+
+	// step timing for iterate(max_seconds)
+	vector<double> level_seconds; //[level]
+	double pixel_pass_seconds;
+
+	// parallel border updating: label changes are written at once, the
+	// histogram and mean updates are buffered per stripe and applied
+	// between the independent phases
+	struct pixel_move { int x, y; UINT from, to; };
+	void update_pixels_parallel(bool means);
+	void update_row(int y, bool forward, bool means, vector<pixel_move>& moves);
+	void update_column(int x, bool forward, bool means, vector<pixel_move>& moves);
+	bool prefers_second(int i, int label1, int label2, int prior1, int prior2, bool means);
+	void move_pixel(int label_new, int x, int y, vector<pixel_move>& moves);
+	void apply_moves(const vector< vector<pixel_move> >& moves);
+	vector< vector<pixel_move> > move_buffers; //[stripe], kept between passes and frames
+	int nr_threads;
 	int threebythree_upperbound;
 	int threebythree_lowerbound;
 
@@ -7,20 +7,26 @@ SEEDSSegmentor::SEEDSSegmentor(void)
 	m_Name = "SEEDS";
 
 	m_NumRegions = 266;
+	m_NumThreads = 1;
+	m_TimeBudget = 0;
+	m_Stream = 0;
+	m_Seeds = NULL;
+	m_SeedsW = m_SeedsH = m_SeedsLevels = 0;
 
-	m_argNum = 1;
+	m_argNum = 4;
 }
 
 SEEDSSegmentor::~SEEDSSegmentor(void)
 {
+	delete m_Seeds;
 }
 
 void SEEDSSegmentor::SetArgs(const vector<float> _args)
 {
 	cout<<"["<<m_Name<<"] Getting arguments..."<<endl;
 
-	float argu[] = {m_NumRegions};
-	string argNames[] = {"NumRegions"};
+	float argu[] = {m_NumRegions, m_NumThreads, m_TimeBudget, m_Stream};
+	string argNames[] = {"NumRegions", "NumThreads", "TimeBudget", "Stream"};
 	cout<<"--Given "<<(_args.size()>m_argNum ? m_argNum : _args.size())<<" argument(s)"; 
 	int i = 0;
 	for ( ; i < _args.size(); i++)
@@ -34,10 +40,16 @@ void SEEDSSegmentor::SetArgs(const vector<float> _args)
 	}
 	cout<<endl;
 
-	m_NumRegions = argu[0];
+	m_NumRegions = argu[0]; m_NumThreads = argu[1]; m_TimeBudget = argu[2];
+	m_Stream = argu[3];
+	m_PostThreads = m_NumThreads;
+	// new arguments start a new sequence: the next Run calls initialize()
+	m_SeedsW = m_SeedsH = m_SeedsLevels = 0;
 
 	stringstream ss;
-	ss<<m_Name<<"_"<<m_NumRegions<<".txt";
+	ss<<m_Name<<"_"<<m_NumRegions;
+	if (m_Stream) ss<<"_s";
+	ss<<".txt";
 	m_ResultName = ss.str();
 }
 
@@ -45,79 +57,60 @@ void SEEDSSegmentor::Run()
 {
 	cout<<"====="<<m_Name<<" Runing..."<<endl;
 
-	IplImage* img = new IplImage(m_Img);
-
-	int width = img->width;
-	int height = img->height;
-	int sz = height*width;
-
-	UINT* ubuff = new UINT[sz];
-	for (int i = 0; i < img->height; i++)
-	{
-		for (int j = 0; j < img->width; j++)
-		{
-			cv::Vec3b bgr = m_Img.at<cv::Vec3b>(i, j);
-			ubuff[i*img->width+j] = (bgr[2]<<16) | (bgr[1]<<8) | (bgr[0]);
-		}
-	}	
+	int width = m_Img.cols;
+	int height = m_Img.rows;
 
 	int NR_BINS = 5; // Number of bins in each histogram channel
 
-	SEEDS seeds(width, height, 3, NR_BINS);
-
-	int nr_superpixels = m_NumRegions;
-	// NOTE: the following values are defined for images from the BSD300 or BSD500 data set.
-	// If the input image size differs from 480x320, the following values might no longer be 
-	// accurate.
-	// For more info on how to select the superpixel sizes, please refer to README.TXT.
-	int seed_width = 3; int seed_height = 4; int nr_levels = 4;
-	if (width >= height)
+	// block size and number of levels from the image size and the requested count;
+	// for 480x320 this gives the presets tuned on BSDS300/500 (see README.TXT)
+	int seed_width, seed_height, nr_levels;
+	SEEDS::plan_blocks(width, height, m_NumRegions, &seed_width, &seed_height, &nr_levels);
+	cout<<"--Blocks "<<seed_width<<"x"<<seed_height<<", "<<nr_levels<<" levels"<<endl;
+	if (m_Seeds == NULL || m_Seeds->get_width() != width || m_Seeds->get_height() != height)
 	{
-		if (nr_superpixels == 600) {seed_width = 2; seed_height = 2; nr_levels = 4;}
-		if (nr_superpixels == 400) {seed_width = 3; seed_height = 2; nr_levels = 4;}
-		if (nr_superpixels == 266) {seed_width = 3; seed_height = 3; nr_levels = 4;}
-		if (nr_superpixels == 200) {seed_width = 3; seed_height = 4; nr_levels = 4;}
-		if (nr_superpixels == 150) {seed_width = 2; seed_height = 2; nr_levels = 5;}
-		if (nr_superpixels == 100) {seed_width = 3; seed_height = 2; nr_levels = 5;}
-		if (nr_superpixels == 50)  {seed_width = 3; seed_height = 4; nr_levels = 5;}
-		if (nr_superpixels == 25)  {seed_width = 3; seed_height = 2; nr_levels = 6;}
-		if (nr_superpixels == 17)  {seed_width = 3; seed_height = 3; nr_levels = 6;}
-		if (nr_superpixels == 12)  {seed_width = 3; seed_height = 4; nr_levels = 6;}
-		if (nr_superpixels == 9)  {seed_width = 2; seed_height = 2; nr_levels = 7;}
-		if (nr_superpixels == 6)  {seed_width = 3; seed_height = 2; nr_levels = 7;}
+		delete m_Seeds;
+		m_Seeds = new SEEDS(width, height, 3, NR_BINS);
+		m_SeedsLevels = 0;
+	}
+	if (seed_width != m_SeedsW || seed_height != m_SeedsH || nr_levels != m_SeedsLevels)
+	{
+		m_Seeds->initialize(seed_width, seed_height, nr_levels);
+		m_SeedsW = seed_width; m_SeedsH = seed_height; m_SeedsLevels = nr_levels;
+	}
+	m_Seeds->set_num_threads(m_NumThreads);
+	// seeds2.cpp is built with HSV_COLORSPACE
+	const float *hvec, *svec, *vvec;
+	m_Cache->HSVPlanes(hvec, svec, vvec);
+	if (m_Stream)
+	{
+		// continues from the labels of the previous frame; the first frame,
+		// and any after a change of size or blocks, starts from the grid
+		m_Seeds->next_frame_bins(m_Cache->HSVBins(NR_BINS), hvec, svec, vvec);
 	}
 	else
+		m_Seeds->reset(m_Cache->HSVBins(NR_BINS), hvec, svec, vvec);
+	if (m_TimeBudget > 0)
 	{
-		if (nr_superpixels == 600) {seed_width = 2; seed_height = 2; nr_levels = 4;}
-		if (nr_superpixels == 400) {seed_width = 2; seed_height = 3; nr_levels = 4;}
-		if (nr_superpixels == 266) {seed_width = 3; seed_height = 3; nr_levels = 4;}
-		if (nr_superpixels == 200) {seed_width = 4; seed_height = 3; nr_levels = 4;}
-		if (nr_superpixels == 150) {seed_width = 2; seed_height = 2; nr_levels = 5;}
-		if (nr_superpixels == 100) {seed_width = 2; seed_height = 3; nr_levels = 5;}
-		if (nr_superpixels == 50)  {seed_width = 4; seed_height = 3; nr_levels = 5;}
-		if (nr_superpixels == 25)  {seed_width = 2; seed_height = 3; nr_levels = 6;}
-		if (nr_superpixels == 17)  {seed_width = 3; seed_height = 3; nr_levels = 6;}
-		if (nr_superpixels == 12)  {seed_width = 4; seed_height = 3; nr_levels = 6;}
-		if (nr_superpixels == 9)  {seed_width = 2; seed_height = 2; nr_levels = 7;}
-		if (nr_superpixels == 6)  {seed_width = 2; seed_height = 3; nr_levels = 7;}
+		if (!m_Seeds->iterate(m_TimeBudget/1000.0))
+			cout<<"--Stopped early for the time budget of "<<m_TimeBudget<<" ms"<<endl;
 	}
-	seeds.initialize(seed_width, seed_height, nr_levels);
-	seeds.update_image_ycbcr(ubuff);
-	seeds.iterate();
-	//int n_Seeds = seeds.count_superpixels();
+	else
+		m_Seeds->iterate();
 
-	int* labels = (int*)seeds.get_labels();
+	const int* labels = (const int*)m_Seeds->get_labels();
 
-	for (int i = 0; i < img->height; i++)
+	for (int i = 0; i < height; i++)
 	{
 		int* ptr = m_Result.ptr<int>(i);
-		for (int j = 0; j < img->width; j++)
+		for (int j = 0; j < width; j++)
 		{
-			ptr[j] = labels[i*img->width+j];
+			ptr[j] = labels[i*width+j];
 		}
 	}
 
-	delete[] ubuff;
-
-	Segmentor::Run();
+	// streamed labels name the same superpixel in every frame, so they are
+	// not renumbered
+	if (!m_Stream)
+		Segmentor::Run();
 }
\ No newline at end of file
@@ -16,7 +16,19 @@ public:
 
 	virtual void Run();
 
+	virtual bool IsStreaming() const { return m_Stream != 0; }
+
 private:
 	int m_NumRegions;
+	int m_NumThreads;	// threads for the pixel-level updates, see SEEDS::set_num_threads
+	float m_TimeBudget;	// ms for SEEDS::iterate, 0 = run all steps
+	int m_Stream;		// != 0: the images are consecutive video frames (batch mode
+						// then runs one decoder and one worker), see SEEDS::next_frame_bins
+
+	// kept across images of the same size and block layout, so that the
+	// SEEDS buffers are not reallocated per frame (the FeatureCache planes
+	// and m_Result still are)
+	SEEDS* m_Seeds;
+	int m_SeedsW, m_SeedsH, m_SeedsLevels;
 };
 
@@ -26,6 +26,16 @@
 #include <iostream>
 #include <fstream>
 #include "SLIC.h"
+#include "../ColorConverter.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SLIC_AVX
+#endif
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SLIC_SSE2
+#endif
 
 #define max(x,y) (x)>(y) ? (x) : (y)
 #define min(x,y) (x)<(y) ? (x) : (y)
@@ -54,13 +64,29 @@ SLIC::SLIC()
 	m_lvecvec = NULL;
 	m_avecvec = NULL;
 	m_bvecvec = NULL;
+
+	m_numthreads = 1;
+	m_floatkernel = false;
+	m_preemptive = false;
+	m_convshift = 0;
+	m_convchanged = 0;
+	m_numitr = 0;
+
+	m_extlab = false;
+	m_extedges = NULL;
+	m_fixedseeds = NULL;
+
+	m_streamstep = 0;
 }
 
 SLIC::~SLIC()
 {
-	if(m_lvec) delete [] m_lvec;
-	if(m_avec) delete [] m_avec;
-	if(m_bvec) delete [] m_bvec;
+	if(!m_extlab)
+	{
+		if(m_lvec) delete [] m_lvec;
+		if(m_avec) delete [] m_avec;
+		if(m_bvec) delete [] m_bvec;
+	}
 
 
 	if(m_lvecvec)
@@ -81,72 +107,60 @@ SLIC::~SLIC()
 }
 
 //==============================================================================
-///	RGB2XYZ
-///
-/// sRGB (D65 illuninant assumption) to XYZ conversion
+///	SetNumThreads
 //==============================================================================
-void SLIC::RGB2XYZ(
-	const int&		sR,
-	const int&		sG,
-	const int&		sB,
-	double&			X,
-	double&			Y,
-	double&			Z)
+void SLIC::SetNumThreads(const int& numthreads)
 {
-	double R = sR/255.0;
-	double G = sG/255.0;
-	double B = sB/255.0;
-
-	double r, g, b;
-
-	if(R <= 0.04045)	r = R/12.92;
-	else				r = pow((R+0.055)/1.055,2.4);
-	if(G <= 0.04045)	g = G/12.92;
-	else				g = pow((G+0.055)/1.055,2.4);
-	if(B <= 0.04045)	b = B/12.92;
-	else				b = pow((B+0.055)/1.055,2.4);
-
-	X = r*0.4124564 + g*0.3575761 + b*0.1804375;
-	Y = r*0.2126729 + g*0.7151522 + b*0.0721750;
-	Z = r*0.0193339 + g*0.1191920 + b*0.9503041;
+	m_numthreads = numthreads < 1 ? 1 : numthreads;
 }
 
-//===========================================================================
-///	RGB2LAB
-//===========================================================================
-void SLIC::RGB2LAB(const int& sR, const int& sG, const int& sB, double& lval, double& aval, double& bval)
+//==============================================================================
+///	SetFloatKernel
+//==============================================================================
+void SLIC::SetFloatKernel(const bool& usefloat)
 {
-	//------------------------
-	// sRGB to XYZ conversion
-	//------------------------
-	double X, Y, Z;
-	RGB2XYZ(sR, sG, sB, X, Y, Z);
-
-	//------------------------
-	// XYZ to LAB conversion
-	//------------------------
-	double epsilon = 0.008856;	//actual CIE standard
-	double kappa   = 903.3;		//actual CIE standard
-
-	double Xr = 0.950456;	//reference white
-	double Yr = 1.0;		//reference white
-	double Zr = 1.088754;	//reference white
+	m_floatkernel = usefloat;
+}
 
-	double xr = X/Xr;
-	double yr = Y/Yr;
-	double zr = Z/Zr;
+//==============================================================================
+///	SetPreemptive
+//==============================================================================
+void SLIC::SetPreemptive(const bool& preemptive)
+{
+	m_preemptive = preemptive;
+}
 
-	double fx, fy, fz;
-	if(xr > epsilon)	fx = pow(xr, 1.0/3.0);
-	else				fx = (kappa*xr + 16.0)/116.0;
-	if(yr > epsilon)	fy = pow(yr, 1.0/3.0);
-	else				fy = (kappa*yr + 16.0)/116.0;
-	if(zr > epsilon)	fz = pow(zr, 1.0/3.0);
-	else				fz = (kappa*zr + 16.0)/116.0;
+//==============================================================================
+///	SetConvergence
+//==============================================================================
+void SLIC::SetConvergence(const double& maxshift, const double& maxchanged)
+{
+	m_convshift = maxshift;
+	m_convchanged = maxchanged;
+}
 
-	lval = 116.0*fy-16.0;
-	aval = 500.0*(fx-fy);
-	bval = 200.0*(fy-fz);
+//==============================================================================
+///	SetLABPlanes
+///
+/// The planes are not copied and are not freed by SLIC.
+//==============================================================================
+void SLIC::SetLABPlanes(
+	const double*				lvec,
+	const double*				avec,
+	const double*				bvec,
+	const vector<double>*		edgemag)
+{
+	if(!m_extlab)
+	{
+		if(m_lvec) delete [] m_lvec;
+		if(m_avec) delete [] m_avec;
+		if(m_bvec) delete [] m_bvec;
+	}
+	m_lvec = const_cast<double*>(lvec);
+	m_avec = const_cast<double*>(avec);
+	m_bvec = const_cast<double*>(bvec);
+	m_extlab = true;
+	m_extedges = edgemag;
 }
 
 //===========================================================================
@@ -165,14 +179,7 @@ void SLIC::DoRGBtoLABConversion(
 	avec = new double[sz];
 	bvec = new double[sz];
 
-	for( int j = 0; j < sz; j++ )
-	{
-		int r = (ubuff[j] >> 16) & 0xFF;
-		int g = (ubuff[j] >>  8) & 0xFF;
-		int b = (ubuff[j]      ) & 0xFF;
-
-		RGB2LAB( r, g, b, lvec[j], avec[j], bvec[j] );
-	}
+	ColorConverter::ARGB2Lab(ubuff, sz, lvec, avec, bvec);
 }
 
 //===========================================================================
@@ -189,14 +196,7 @@ void SLIC::DoRGBtoLABConversion(
 	int sz = m_width*m_height;
 	for( int d = 0; d < m_depth; d++ )
 	{
-		for( int j = 0; j < sz; j++ )
-		{
-			int r = (ubuff[d][j] >> 16) & 0xFF;
-			int g = (ubuff[d][j] >>  8) & 0xFF;
-			int b = (ubuff[d][j]      ) & 0xFF;
-
-			RGB2LAB( r, g, b, lvec[d][j], avec[d][j], bvec[d][j] );
-		}
+		ColorConverter::ARGB2Lab(ubuff[d], sz, lvec[d], avec[d], bvec[d]);
 	}
 }
 
@@ -329,8 +329,75 @@ void SLIC::DrawContoursAroundSegmentsTwoColors(
 }
 
 
+//==============================================================================
+///	LabEdgeRow
+///
+/// Gradient magnitudes of pixels i0 .. i0+count-1, all of which must be
+/// interior. The SIMD paths keep the scalar evaluation order, so the results
+/// are bit-identical to LabEdgeAt().
+//==============================================================================
+static void LabEdgeRow(
+	const double*				lvec,
+	const double*				avec,
+	const double*				bvec,
+	const int					width,
+	const int					i0,
+	const int					count,
+	double*						edges)
+{
+	int k = 0;
+#ifdef SLIC_AVX
+	for( ; k+4 <= count; k += 4 )
+	{
+		int i = i0+k;
+		__m256d dl = _mm256_sub_pd(_mm256_loadu_pd(lvec+i-1), _mm256_loadu_pd(lvec+i+1));
+		__m256d da = _mm256_sub_pd(_mm256_loadu_pd(avec+i-1), _mm256_loadu_pd(avec+i+1));
+		__m256d db = _mm256_sub_pd(_mm256_loadu_pd(bvec+i-1), _mm256_loadu_pd(bvec+i+1));
+		__m256d dx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dl,dl), _mm256_mul_pd(da,da)), _mm256_mul_pd(db,db));
+		dl = _mm256_sub_pd(_mm256_loadu_pd(lvec+i-width), _mm256_loadu_pd(lvec+i+width));
+		da = _mm256_sub_pd(_mm256_loadu_pd(avec+i-width), _mm256_loadu_pd(avec+i+width));
+		db = _mm256_sub_pd(_mm256_loadu_pd(bvec+i-width), _mm256_loadu_pd(bvec+i+width));
+		__m256d dy = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dl,dl), _mm256_mul_pd(da,da)), _mm256_mul_pd(db,db));
+		_mm256_storeu_pd(edges+k, _mm256_add_pd(dx, dy));
+	}
+#endif
+#ifdef SLIC_SSE2
+	for( ; k+2 <= count; k += 2 )
+	{
+		int i = i0+k;
+		__m128d dl = _mm_sub_pd(_mm_loadu_pd(lvec+i-1), _mm_loadu_pd(lvec+i+1));
+		__m128d da = _mm_sub_pd(_mm_loadu_pd(avec+i-1), _mm_loadu_pd(avec+i+1));
+		__m128d db = _mm_sub_pd(_mm_loadu_pd(bvec+i-1), _mm_loadu_pd(bvec+i+1));
+		__m128d dx = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dl,dl), _mm_mul_pd(da,da)), _mm_mul_pd(db,db));
+		dl = _mm_sub_pd(_mm_loadu_pd(lvec+i-width), _mm_loadu_pd(lvec+i+width));
+		da = _mm_sub_pd(_mm_loadu_pd(avec+i-width), _mm_loadu_pd(avec+i+width));
+		db = _mm_sub_pd(_mm_loadu_pd(bvec+i-width), _mm_loadu_pd(bvec+i+width));
+		__m128d dy = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dl,dl), _mm_mul_pd(da,da)), _mm_mul_pd(db,db));
+		_mm_storeu_pd(edges+k, _mm_add_pd(dx, dy));
+	}
+#endif
+	for( ; k < count; k++ )
+	{
+		int i = i0+k;
+
+		double dx = (lvec[i-1]-lvec[i+1])*(lvec[i-1]-lvec[i+1]) +
+					(avec[i-1]-avec[i+1])*(avec[i-1]-avec[i+1]) +
+					(bvec[i-1]-bvec[i+1])*(bvec[i-1]-bvec[i+1]);
+
+		double dy = (lvec[i-width]-lvec[i+width])*(lvec[i-width]-lvec[i+width]) +
+					(avec[i-width]-avec[i+width])*(avec[i-width]-avec[i+width]) +
+					(bvec[i-width]-bvec[i+width])*(bvec[i-width]-bvec[i+width]);
+
+		//edges[k] = (sqrt(dx) + sqrt(dy));
+		edges[k] = (dx + dy);
+	}
+}
+
 //==============================================================================
 ///	DetectLabEdges
+///
+/// Full-image gradient map, vectorized along the rows and split over
+/// numthreads row bands. Border pixels are 0.
 //==============================================================================
 void SLIC::DetectLabEdges(
 	const double*				lvec,
@@ -338,33 +405,47 @@ void SLIC::DetectLabEdges(
 	const double*				bvec,
 	const int&					width,
 	const int&					height,
-	vector<double>&				edges)
+	vector<double>&				edges,
+	const int&					numthreads)
 {
 	int sz = width*height;
 
-	edges.resize(sz,0);
+	edges.resize(sz);
+	if( sz == 0 ) return;
+	{for( int k = 0; k < width; k++ ) { edges[k] = 0; edges[sz-width+k] = 0; }}
+	{for( int j = 0; j < height; j++ ) { edges[j*width] = 0; edges[j*width+width-1] = 0; }}
+	if( width < 3 ) return;
+
+	double* out = &edges[0];
+	const int nthreads = numthreads > 1 ? numthreads : 1;
+	#pragma omp parallel for num_threads(nthreads) if(nthreads > 1)
 	for( int j = 1; j < height-1; j++ )
 	{
-		for( int k = 1; k < width-1; k++ )
-		{
-			int i = j*width+k;
-
-			double dx = (lvec[i-1]-lvec[i+1])*(lvec[i-1]-lvec[i+1]) +
-						(avec[i-1]-avec[i+1])*(avec[i-1]-avec[i+1]) +
-						(bvec[i-1]-bvec[i+1])*(bvec[i-1]-bvec[i+1]);
+		LabEdgeRow(lvec, avec, bvec, width, j*width+1, width-2, out+j*width+1);
+	}
+}
 
-			double dy = (lvec[i-width]-lvec[i+width])*(lvec[i-width]-lvec[i+width]) +
-						(avec[i-width]-avec[i+width])*(avec[i-width]-avec[i+width]) +
-						(bvec[i-width]-bvec[i+width])*(bvec[i-width]-bvec[i+width]);
+//==============================================================================
+///	LabEdgeAt
+///
+/// Gradient magnitude of a single pixel, equal to DetectLabEdges()[ind].
+//==============================================================================
+double SLIC::LabEdgeAt(const int& ind) const
+{
+	int x = ind%m_width;
+	int y = ind/m_width;
+	if( x < 1 || x >= m_width-1 || y < 1 || y >= m_height-1 ) return 0;
 
-			//edges[i] = (sqrt(dx) + sqrt(dy));
-			edges[i] = (dx + dy);
-		}
-	}
+	double e;
+	LabEdgeRow(m_lvec, m_avec, m_bvec, m_width, ind, 1, &e);
+	return e;
 }
 
 //===========================================================================
 ///	PerturbSeeds
+///
+/// An empty edge map makes the gradients be evaluated lazily, only in the
+/// 3x3 neighbourhood of each seed.
 //===========================================================================
 void SLIC::PerturbSeeds(
 	vector<double>&				kseedsl,
@@ -376,6 +457,7 @@ void SLIC::PerturbSeeds(
 {
 	const int dx8[8] = {-1, -1,  0,  1, 1, 1, 0, -1};
 	const int dy8[8] = { 0, -1, -1, -1, 0, 1, 1,  1};
+	const bool lazy = edges.empty();
 	
 	int numseeds = kseedsl.size();
 
@@ -386,6 +468,7 @@ void SLIC::PerturbSeeds(
 		int oind = oy*m_width + ox;
 
 		int storeind = oind;
+		double storeedge = lazy ? LabEdgeAt(oind) : edges[oind];
 		for( int i = 0; i < 8; i++ )
 		{
 			int nx = ox+dx8[i];//new x
@@ -394,9 +477,11 @@ void SLIC::PerturbSeeds(
 			if( nx >= 0 && nx < m_width && ny >= 0 && ny < m_height)
 			{
 				int nind = ny*m_width + nx;
-				if( edges[nind] < edges[storeind])
+				double nedge = lazy ? LabEdgeAt(nind) : edges[nind];
+				if( nedge < storeedge)
 				{
 					storeind = nind;
+					storeedge = nedge;
 				}
 			}
 		}
@@ -563,6 +648,12 @@ void SLIC::PerformSuperpixelSegmentation_VariableSandM(
 	const int&					STEP,
 	const int&					NUMITR)
 {
+	if( m_floatkernel )
+	{
+		PerformSuperpixelSegmentation_VariableSandM_Float(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, klabels, STEP, NUMITR);
+		return;
+	}
+
 	int sz = m_width*m_height;
 	const int numk = kseedsl.size();
 	//double cumerr(99999.9);
@@ -588,48 +679,86 @@ void SLIC::PerformSuperpixelSegmentation_VariableSandM(
 
 	double invxywt = 1.0/(STEP*STEP);//NOTE: this is different from how usual SLIC/LKM works
 
-	while( numitr < NUMITR )
+	const bool checkconv = m_convshift > 0 || m_convchanged > 0;
+	vector<double> oldx, oldy;
+	vector<int> prevlabels(checkconv ? sz : 0, -1);
+	bool converged(false);
+
+	//-----------------------------------------------------------------
+	// Preemptive mode: every seed is active in the first iteration
+	//-----------------------------------------------------------------
+	vector<char> active(numk, 1);
+	vector<char> moved;
+	vector< vector<int> > neighbours;
+	vector<int> lastlabels;
+	vector<double> lastmaxlab;
+	vector<double> nbx, nby;//seed positions the neighbour lists were built from
+	if( m_preemptive )
+	{
+		BuildSeedNeighbours(kseedsx, kseedsy, 2*offset + STEP, neighbours);
+		nbx = kseedsx;
+		nby = kseedsy;
+		lastlabels.assign(klabels, klabels + sz);
+		lastmaxlab = maxlab;
+	}
+
+	while( numitr < NUMITR && !converged )
 	{
 		//------
 		//cumerr = 0;
 		numitr++;
 		//------
 
-		distvec.assign(sz, DBL_MAX);
-		for( int n = 0; n < numk; n++ )
+		if( m_preemptive && numitr > 1 )
 		{
-			int y1 = max(0,			kseedsy[n]-offset);
-			int y2 = min(m_height,	kseedsy[n]+offset);
-			int x1 = max(0,			kseedsx[n]-offset);
-			int x2 = min(m_width,	kseedsx[n]+offset);
-
-			for( int y = y1; y < y2; y++ )
+			// pixels of a moved seed are assigned afresh; the others keep the
+			// distance to their seed, which has not changed
+			for( int i = 0; i < sz; i++ ) if( moved[klabels[i]] ) distvec[i] = DBL_MAX;
+		}
+		else distvec.assign(sz, DBL_MAX);
+		if( m_numthreads > 1 )
+		{
+			AssignSeeds_Tiled(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, maxlab, invxywt, offset,
+				klabels, distlab, distxy, distvec, m_preemptive ? &active : NULL);
+		}
+		else
+		{
+			for( int n = 0; n < numk; n++ )
 			{
-				for( int x = x1; x < x2; x++ )
-				{
-					int i = y*m_width + x;
-					_ASSERT( y < m_height && x < m_width && y >= 0 && x >= 0 );
-
-					double l = m_lvec[i];
-					double a = m_avec[i];
-					double b = m_bvec[i];
-
-					distlab[i] =	(l - kseedsl[n])*(l - kseedsl[n]) +
-									(a - kseedsa[n])*(a - kseedsa[n]) +
-									(b - kseedsb[n])*(b - kseedsb[n]);
-
-					distxy[i] =		(x - kseedsx[n])*(x - kseedsx[n]) +
-									(y - kseedsy[n])*(y - kseedsy[n]);
+				if( !active[n] ) continue;
+				int y1 = max(0,			kseedsy[n]-offset);
+				int y2 = min(m_height,	kseedsy[n]+offset);
+				int x1 = max(0,			kseedsx[n]-offset);
+				int x2 = min(m_width,	kseedsx[n]+offset);
 
-					//------------------------------------------------------------------------
-					double dist = distlab[i]/maxlab[n] + distxy[i]*invxywt;//only varying m, prettier superpixels
-					//double dist = distlab[i]/maxlab[n] + distxy[i]/maxxy[n];//varying both m and S
-					//------------------------------------------------------------------------
-					
-					if( dist < distvec[i] )
+				for( int y = y1; y < y2; y++ )
+				{
+					for( int x = x1; x < x2; x++ )
 					{
-						distvec[i] = dist;
-						klabels[i]  = n;
+						int i = y*m_width + x;
+						_ASSERT( y < m_height && x < m_width && y >= 0 && x >= 0 );
+
+						double l = m_lvec[i];
+						double a = m_avec[i];
+						double b = m_bvec[i];
+
+						distlab[i] =	(l - kseedsl[n])*(l - kseedsl[n]) +
+										(a - kseedsa[n])*(a - kseedsa[n]) +
+										(b - kseedsb[n])*(b - kseedsb[n]);
+
+						distxy[i] =		(x - kseedsx[n])*(x - kseedsx[n]) +
+										(y - kseedsy[n])*(y - kseedsy[n]);
+
+						//------------------------------------------------------------------------
+						double dist = distlab[i]/maxlab[n] + distxy[i]*invxywt;//only varying m, prettier superpixels
+						//double dist = distlab[i]/maxlab[n] + distxy[i]/maxxy[n];//varying both m and S
+						//------------------------------------------------------------------------
+						
+						if( dist < distvec[i] )
+						{
+							distvec[i] = dist;
+							klabels[i]  = n;
+						}
 					}
 				}
 			}
@@ -642,14 +771,6 @@ void SLIC::PerformSuperpixelSegmentation_VariableSandM(
 			maxlab.assign(numk,1);
 			maxxy.assign(numk,1);
 		}
-		{for( int i = 0; i < sz; i++ )
-		{
-			if(maxlab[klabels[i]] < distlab[i]) maxlab[klabels[i]] = distlab[i];
-			if(maxxy[klabels[i]] < distxy[i]) maxxy[klabels[i]] = distxy[i];
-		}}
-		//-----------------------------------------------------------------
-		// Recalculate the centroid and store in the seed values
-		//-----------------------------------------------------------------
 		sigmal.assign(numk, 0);
 		sigmaa.assign(numk, 0);
 		sigmab.assign(numk, 0);
@@ -657,17 +778,45 @@ void SLIC::PerformSuperpixelSegmentation_VariableSandM(
 		sigmay.assign(numk, 0);
 		clustersize.assign(numk, 0);
 
-		for( int j = 0; j < sz; j++ )
+		bool accumulated(false);
+		if( m_numthreads > 1 && !m_preemptive )
 		{
-			int temp = klabels[j];
-			_ASSERT(klabels[j] >= 0);
-			sigmal[klabels[j]] += m_lvec[j];
-			sigmaa[klabels[j]] += m_avec[j];
-			sigmab[klabels[j]] += m_bvec[j];
-			sigmax[klabels[j]] += (j%m_width);
-			sigmay[klabels[j]] += (j/m_width);
-
-			clustersize[klabels[j]]++;
+			accumulated = AccumulateSeeds_Tiled<double>(m_lvec, m_avec, m_bvec, kseedsx, kseedsy, offset, klabels,
+				&distlab[0], &distxy[0], maxlab, maxxy, sigmal, sigmaa, sigmab, sigmax, sigmay, clustersize);
+			if( !accumulated )
+			{
+				sigmal.assign(numk, 0);
+				sigmaa.assign(numk, 0);
+				sigmab.assign(numk, 0);
+				sigmax.assign(numk, 0);
+				sigmay.assign(numk, 0);
+				clustersize.assign(numk, 0);
+			}
+		}
+		if( !accumulated )
+		{
+			{for( int i = 0; i < sz; i++ )
+			{
+				if( !active[klabels[i]] ) continue;
+				if(maxlab[klabels[i]] < distlab[i]) maxlab[klabels[i]] = distlab[i];
+				if(maxxy[klabels[i]] < distxy[i]) maxxy[klabels[i]] = distxy[i];
+			}}
+			//-----------------------------------------------------------------
+			// Recalculate the centroid and store in the seed values
+			//-----------------------------------------------------------------
+			for( int j = 0; j < sz; j++ )
+			{
+				int temp = klabels[j];
+				_ASSERT(klabels[j] >= 0);
+				if( !active[temp] ) continue;
+				sigmal[klabels[j]] += m_lvec[j];
+				sigmaa[klabels[j]] += m_avec[j];
+				sigmab[klabels[j]] += m_bvec[j];
+				sigmax[klabels[j]] += (j%m_width);
+				sigmay[klabels[j]] += (j/m_width);
+
+				clustersize[klabels[j]]++;
+			}
 		}
 
 		{for( int k = 0; k < numk; k++ )
@@ -677,156 +826,897 @@ void SLIC::PerformSuperpixelSegmentation_VariableSandM(
 			inv[k] = 1.0/double(clustersize[k]);//computing inverse now to multiply, than divide later
 		}}
 		
+		if( checkconv )
+		{
+			oldx = kseedsx;
+			oldy = kseedsy;
+		}
 		{for( int k = 0; k < numk; k++ )
 		{
+			if( !active[k] ) continue;
+			if( m_fixedseeds && (*m_fixedseeds)[k] ) continue;
 			kseedsl[k] = sigmal[k]*inv[k];
 			kseedsa[k] = sigmaa[k]*inv[k];
 			kseedsb[k] = sigmab[k]*inv[k];
 			kseedsx[k] = sigmax[k]*inv[k];
 			kseedsy[k] = sigmay[k]*inv[k];
 		}}
+		if( checkconv ) converged = CheckConvergence(oldx, oldy, kseedsx, kseedsy, klabels, prevlabels);
+		if( m_preemptive )
+		{
+			// the lists carry a margin of STEP, shared by the two seeds of a pair
+			if( SeedsDrifted(nbx, nby, kseedsx, kseedsy, 0.5*STEP) )
+			{
+				BuildSeedNeighbours(kseedsx, kseedsy, 2*offset + STEP, neighbours);
+				nbx = kseedsx;
+				nby = kseedsy;
+			}
+			UpdateActiveSeeds(klabels, maxlab, neighbours, lastlabels, lastmaxlab, moved, active);
+		}
 	}
+	m_numitr = numitr;
 }
 
 //===========================================================================
-///	SaveSuperpixelLabels
+///	AssignRow_Float
 ///
-///	Save labels in raster scan order.
+/// Distance and arg-min update of seed n over pixels [x1,x2) of one row.
+/// distlab is written for every pixel, as in the double kernel.
 //===========================================================================
-void SLIC::SaveSuperpixelLabels(
-	const int*					labels,
-	const int&					width,
-	const int&					height,
-	const string&				filename,
-	const string&				path) 
+static void AssignRow_Float(
+	const float*				lrow,
+	const float*				arow,
+	const float*				brow,
+	const int&					x1,
+	const int&					x2,
+	const float&				dy2,
+	const float&				sl,
+	const float&				sa,
+	const float&				sb,
+	const float&				sx,
+	const float&				invmaxlab,
+	const float&				invxywt,
+	const int&					n,
+	float*						distlab,
+	float*						distvec,
+	int*						labels)
 {
-	int sz = width*height;
-
-	char fname[_MAX_FNAME];
-	char extn[_MAX_FNAME];
-	_splitpath(filename.c_str(), NULL, NULL, fname, extn);
-	string temp = fname;
-
-	ofstream outfile;
-	string finalpath = path + temp + string(".dat");
-	outfile.open(finalpath.c_str(), ios::binary);
-	for( int i = 0; i < sz; i++ )
+	int x = x1;
+#ifdef SLIC_AVX
 	{
-		outfile.write((const char*)&labels[i], sizeof(int));
+		const __m256 vsl = _mm256_set1_ps(sl);
+		const __m256 vsa = _mm256_set1_ps(sa);
+		const __m256 vsb = _mm256_set1_ps(sb);
+		const __m256 vsx = _mm256_set1_ps(sx);
+		const __m256 vdy2 = _mm256_set1_ps(dy2);
+		const __m256 vinvmaxlab = _mm256_set1_ps(invmaxlab);
+		const __m256 vinvxywt = _mm256_set1_ps(invxywt);
+		const __m256 vn = _mm256_castsi256_ps(_mm256_set1_epi32(n));
+		const __m256 vstep = _mm256_set1_ps(8.0f);
+		__m256 vx = _mm256_add_ps(_mm256_set1_ps(float(x)), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+		for( ; x + 8 <= x2; x += 8 )
+		{
+			__m256 dl = _mm256_sub_ps(_mm256_loadu_ps(lrow + x), vsl);
+			__m256 da = _mm256_sub_ps(_mm256_loadu_ps(arow + x), vsa);
+			__m256 db = _mm256_sub_ps(_mm256_loadu_ps(brow + x), vsb);
+			__m256 dlab = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dl, dl), _mm256_mul_ps(da, da)), _mm256_mul_ps(db, db));
+			__m256 dx = _mm256_sub_ps(vx, vsx);
+			__m256 dxy = _mm256_add_ps(_mm256_mul_ps(dx, dx), vdy2);
+			__m256 dist = _mm256_add_ps(_mm256_mul_ps(dlab, vinvmaxlab), _mm256_mul_ps(dxy, vinvxywt));
+			_mm256_storeu_ps(distlab + x, dlab);
+
+			__m256 old = _mm256_loadu_ps(distvec + x);
+			__m256 mask = _mm256_cmp_ps(dist, old, _CMP_LT_OQ);
+			_mm256_storeu_ps(distvec + x, _mm256_blendv_ps(old, dist, mask));
+			__m256 lab = _mm256_loadu_ps((const float*)(labels + x));
+			_mm256_storeu_ps((float*)(labels + x), _mm256_blendv_ps(lab, vn, mask));
+			vx = _mm256_add_ps(vx, vstep);
+		}
+	}
+#endif
+#ifdef SLIC_SSE2
+	{
+		const __m128 vsl = _mm_set1_ps(sl);
+		const __m128 vsa = _mm_set1_ps(sa);
+		const __m128 vsb = _mm_set1_ps(sb);
+		const __m128 vsx = _mm_set1_ps(sx);
+		const __m128 vdy2 = _mm_set1_ps(dy2);
+		const __m128 vinvmaxlab = _mm_set1_ps(invmaxlab);
+		const __m128 vinvxywt = _mm_set1_ps(invxywt);
+		const __m128i vn = _mm_set1_epi32(n);
+		const __m128 vstep = _mm_set1_ps(4.0f);
+		__m128 vx = _mm_add_ps(_mm_set1_ps(float(x)), _mm_setr_ps(0, 1, 2, 3));
+		for( ; x + 4 <= x2; x += 4 )
+		{
+			__m128 dl = _mm_sub_ps(_mm_loadu_ps(lrow + x), vsl);
+			__m128 da = _mm_sub_ps(_mm_loadu_ps(arow + x), vsa);
+			__m128 db = _mm_sub_ps(_mm_loadu_ps(brow + x), vsb);
+			__m128 dlab = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dl, dl), _mm_mul_ps(da, da)), _mm_mul_ps(db, db));
+			__m128 dx = _mm_sub_ps(vx, vsx);
+			__m128 dxy = _mm_add_ps(_mm_mul_ps(dx, dx), vdy2);
+			__m128 dist = _mm_add_ps(_mm_mul_ps(dlab, vinvmaxlab), _mm_mul_ps(dxy, vinvxywt));
+			_mm_storeu_ps(distlab + x, dlab);
+
+			__m128 old = _mm_loadu_ps(distvec + x);
+			__m128 mask = _mm_cmplt_ps(dist, old);
+			_mm_storeu_ps(distvec + x, _mm_or_ps(_mm_and_ps(mask, dist), _mm_andnot_ps(mask, old)));
+			__m128i imask = _mm_castps_si128(mask);
+			__m128i lab = _mm_loadu_si128((const __m128i*)(labels + x));
+			_mm_storeu_si128((__m128i*)(labels + x), _mm_or_si128(_mm_and_si128(imask, vn), _mm_andnot_si128(imask, lab)));
+			vx = _mm_add_ps(vx, vstep);
+		}
+	}
+#endif
+	for( ; x < x2; x++ )
+	{
+		float dl = lrow[x] - sl;
+		float da = arow[x] - sa;
+		float db = brow[x] - sb;
+		float dlab = dl*dl + da*da + db*db;
+		float dx = float(x) - sx;
+		float dist = dlab*invmaxlab + (dx*dx + dy2)*invxywt;
+		distlab[x] = dlab;
+		if( dist < distvec[x] )
+		{
+			distvec[x] = dist;
+			labels[x] = n;
+		}
 	}
-	outfile.close();
 }
 
 //===========================================================================
-///	EnforceLabelConnectivity
+///	PerformSuperpixelSegmentation_VariableSandM_Float
 ///
-///		1. finding an adjacent label for each new component at the start
-///		2. if a certain component is too small, assigning the previously found
-///		    adjacent label to this component, and not incrementing the label.
+/// Same iterations as PerformSuperpixelSegmentation_VariableSandM, with
+/// float Lab planes and 8 bytes of distance scratch per pixel instead of 24.
+/// distxy is not kept since maxxy does not take part in the distance.
+/// Centroid sums are still accumulated in double.
 //===========================================================================
-void SLIC::EnforceLabelConnectivity(
-	const int*					labels,//input labels that need to be corrected to remove stray labels
-	const int&					width,
-	const int&					height,
-	int*						nlabels,//new labels
-	int&						numlabels,//the number of labels changes in the end if segments are removed
-	const int&					K) //the number of superpixels desired by the user
+void SLIC::PerformSuperpixelSegmentation_VariableSandM_Float(
+	vector<double>&				kseedsl,
+	vector<double>&				kseedsa,
+	vector<double>&				kseedsb,
+	vector<double>&				kseedsx,
+	vector<double>&				kseedsy,
+	int*						klabels,
+	const int&					STEP,
+	const int&					NUMITR)
 {
-//	const int dx8[8] = {-1, -1,  0,  1, 1, 1, 0, -1};
-//	const int dy8[8] = { 0, -1, -1, -1, 0, 1, 1,  1};
+	int sz = m_width*m_height;
+	const int numk = kseedsl.size();
+	int numitr(0);
 
-	const int dx4[4] = {-1,  0,  1,  0};
-	const int dy4[4] = { 0, -1,  0,  1};
+	//----------------
+	int offset = STEP;
+	if(STEP < 10) offset = STEP*1.5;
+	//----------------
 
-	const int sz = width*height;
-	const int SUPSZ = sz/K;
-	//nlabels.resize(sz, -1);
-	for( int i = 0; i < sz; i++ ) nlabels[i] = -1;
-	int label(0);
-	int* xvec = new int[sz];
-	int* yvec = new int[sz];
-	int oindex(0);
-	int adjlabel(0);//adjacent label
-	for( int j = 0; j < height; j++ )
+	// one float copy per image, reused across calls of the same size; the
+	// double planes are not read again, so drop them unless they belong to
+	// the caller
+	m_lvecf.resize(sz);
+	m_avecf.resize(sz);
+	m_bvecf.resize(sz);
+	{for( int i = 0; i < sz; i++ )
 	{
-		for( int k = 0; k < width; k++ )
+		m_lvecf[i] = float(m_lvec[i]);
+		m_avecf[i] = float(m_avec[i]);
+		m_bvecf[i] = float(m_bvec[i]);
+	}}
+	if(!m_extlab)
+	{
+		delete [] m_lvec; m_lvec = NULL;
+		delete [] m_avec; m_avec = NULL;
+		delete [] m_bvec; m_bvec = NULL;
+	}
+	const float* lvec = &m_lvecf[0];
+	const float* avec = &m_avecf[0];
+	const float* bvec = &m_bvecf[0];
+
+	vector<double> sigmal(numk, 0);
+	vector<double> sigmaa(numk, 0);
+	vector<double> sigmab(numk, 0);
+	vector<double> sigmax(numk, 0);
+	vector<double> sigmay(numk, 0);
+	vector<int> clustersize(numk, 0);
+	vector<double> inv(numk, 0);//to store 1/clustersize[k] values
+	vector<float> distlab(sz, FLT_MAX);
+	vector<float> distvec(sz, FLT_MAX);
+	vector<float> maxlab(numk, 10*10);//THIS IS THE VARIABLE VALUE OF M, just start with 10
+	vector<float> maxxy(numk, float(STEP*STEP));//unused, see above
+
+	const float invxywt = 1.0f/(STEP*STEP);
+
+	const bool checkconv = m_convshift > 0 || m_convchanged > 0;
+	vector<double> oldx, oldy;
+	vector<int> prevlabels(checkconv ? sz : 0, -1);
+	bool converged(false);
+
+	const int numtiles = (m_numthreads > 1) ? (min(m_height, 4*m_numthreads)) : 1;
+	vector<int> rowtile(m_height);
+	{for( int t = 0; t < numtiles; t++ )
+	{
+		int r1, r2;
+		GetTileRows(t, numtiles, r1, r2);
+		for( int y = r1; y < r2; y++ ) rowtile[y] = t;
+	}}
+	vector< vector<int> > tileseeds(numtiles);
+
+	while( numitr < NUMITR && !converged )
+	{
+		numitr++;
+
+		distvec.assign(sz, FLT_MAX);
+		{for( int t = 0; t < numtiles; t++ ) tileseeds[t].clear();}
+		{for( int n = 0; n < numk; n++ )
+		{
+			int y1 = max(0,			kseedsy[n]-offset);
+			int y2 = min(m_height,	kseedsy[n]+offset);
+			if( y1 >= y2 ) continue;
+			for( int t = rowtile[y1]; t <= rowtile[y2-1]; t++ ) tileseeds[t].push_back(n);
+		}}
+
+		#pragma omp parallel for num_threads(m_numthreads) schedule(dynamic) if(numtiles > 1)
+		for( int t = 0; t < numtiles; t++ )
 		{
-			if( 0 > nlabels[oindex] )
+			int r1, r2;
+			GetTileRows(t, numtiles, r1, r2);
+			const vector<int>& seeds = tileseeds[t];
+
+			for( int s = 0; s < int(seeds.size()); s++ )
 			{
-				nlabels[oindex] = label;
-				//--------------------
-				// Start a new segment
-				//--------------------
-				xvec[0] = k;
-				yvec[0] = j;
-				//-------------------------------------------------------
-				// Quickly find an adjacent label for use later if needed
-				//-------------------------------------------------------
-				{for( int n = 0; n < 4; n++ )
+				const int n = seeds[s];
+				int y1 = max(0,			kseedsy[n]-offset);
+				int y2 = min(m_height,	kseedsy[n]+offset);
+				int x1 = max(0,			kseedsx[n]-offset);
+				int x2 = min(m_width,	kseedsx[n]+offset);
+				if( y1 < r1 ) y1 = r1;
+				if( y2 > r2 ) y2 = r2;
+
+				const float sl = float(kseedsl[n]);
+				const float sa = float(kseedsa[n]);
+				const float sb = float(kseedsb[n]);
+				const float sx = float(kseedsx[n]);
+				const float sy = float(kseedsy[n]);
+				const float invmaxlab = 1.0f/maxlab[n];
+
+				for( int y = y1; y < y2; y++ )
 				{
-					int x = xvec[0] + dx4[n];
-					int y = yvec[0] + dy4[n];
-					if( (x >= 0 && x < width) && (y >= 0 && y < height) )
-					{
-						int nindex = y*width + x;
-						if(nlabels[nindex] >= 0) adjlabel = nlabels[nindex];
-					}
-				}}
+					const int row = y*m_width;
+					const float dy = float(y) - sy;
+					AssignRow_Float(&lvec[row], &avec[row], &bvec[row], x1, x2, dy*dy,
+						sl, sa, sb, sx, invmaxlab, invxywt, n,
+						&distlab[row], &distvec[row], klabels + row);
+				}
+			}
+		}
 
-				int count(1);
-				for( int c = 0; c < count; c++ )
-				{
-					for( int n = 0; n < 4; n++ )
-					{
-						int x = xvec[c] + dx4[n];
-						int y = yvec[c] + dy4[n];
+		//-----------------------------------------------------------------
+		// Assign the max color distance for a cluster, and recalculate
+		// the centroid
+		//-----------------------------------------------------------------
+		sigmal.assign(numk, 0);
+		sigmaa.assign(numk, 0);
+		sigmab.assign(numk, 0);
+		sigmax.assign(numk, 0);
+		sigmay.assign(numk, 0);
+		clustersize.assign(numk, 0);
 
-						if( (x >= 0 && x < width) && (y >= 0 && y < height) )
-						{
-							int nindex = y*width + x;
-
-							if( 0 > nlabels[nindex] && labels[oindex] == labels[nindex] )
-							{
-								xvec[count] = x;
-								yvec[count] = y;
-								nlabels[nindex] = label;
-								count++;
-							}
-						}
+		bool accumulated(false);
+		if( numtiles > 1 )
+		{
+			accumulated = AccumulateSeeds_Tiled<float>(lvec, avec, bvec, kseedsx, kseedsy, offset, klabels,
+				&distlab[0], NULL, maxlab, maxxy, sigmal, sigmaa, sigmab, sigmax, sigmay, clustersize);
+			if( !accumulated )
+			{
+				sigmal.assign(numk, 0);
+				sigmaa.assign(numk, 0);
+				sigmab.assign(numk, 0);
+				sigmax.assign(numk, 0);
+				sigmay.assign(numk, 0);
+				clustersize.assign(numk, 0);
+			}
+		}
+		if( !accumulated )
+		{
+			for( int j = 0; j < sz; j++ )
+			{
+				const int k = klabels[j];
+				_ASSERT(k >= 0);
+				if(maxlab[k] < distlab[j]) maxlab[k] = distlab[j];
 
-					}
-				}
-				//-------------------------------------------------------
-				// If segment size is less then a limit, assign an
-				// adjacent label found before, and decrement label count.
-				//-------------------------------------------------------
-				if(count <= SUPSZ >> 2)
-				{
-					for( int c = 0; c < count; c++ )
-					{
-						int ind = yvec[c]*width+xvec[c];
-						nlabels[ind] = adjlabel;
-					}
-					label--;
-				}
-				label++;
+				sigmal[k] += lvec[j];
+				sigmaa[k] += avec[j];
+				sigmab[k] += bvec[j];
+				sigmax[k] += (j%m_width);
+				sigmay[k] += (j/m_width);
+
+				clustersize[k]++;
 			}
-			oindex++;
 		}
-	}
-	numlabels = label;
 
-	if(xvec) delete [] xvec;
-	if(yvec) delete [] yvec;
-}
+		{for( int k = 0; k < numk; k++ )
+		{
+			if( clustersize[k] <= 0 ) clustersize[k] = 1;
+			inv[k] = 1.0/double(clustersize[k]);
+		}}
 
-//===========================================================================
-///	PerformSLICO_ForGivenStepSize
-///
-/// There is option to save the labels if needed.
-//===========================================================================
-void SLIC::PerformSLICO_ForGivenStepSize(
-	const unsigned int*			ubuff,
+		if( checkconv )
+		{
+			oldx = kseedsx;
+			oldy = kseedsy;
+		}
+		{for( int k = 0; k < numk; k++ )
+		{
+			if( m_fixedseeds && (*m_fixedseeds)[k] ) continue;
+			kseedsl[k] = sigmal[k]*inv[k];
+			kseedsa[k] = sigmaa[k]*inv[k];
+			kseedsb[k] = sigmab[k]*inv[k];
+			kseedsx[k] = sigmax[k]*inv[k];
+			kseedsy[k] = sigmay[k]*inv[k];
+		}}
+		if( checkconv ) converged = CheckConvergence(oldx, oldy, kseedsx, kseedsy, klabels, prevlabels);
+	}
+	m_numitr = numitr;
+}
+
+//===========================================================================
+///	CheckConvergence
+///
+/// The shift is the largest Euclidean move of a seed in the image plane.
+/// The first iteration never converges since prevlabels starts at -1.
+//===========================================================================
+bool SLIC::CheckConvergence(
+	const vector<double>&		oldx,
+	const vector<double>&		oldy,
+	const vector<double>&		kseedsx,
+	const vector<double>&		kseedsy,
+	const int*					klabels,
+	vector<int>&				prevlabels)
+{
+	const int sz = m_width*m_height;
+	const int numk = kseedsx.size();
+
+	double maxshift2(0);
+	{for( int k = 0; k < numk; k++ )
+	{
+		double dx = kseedsx[k] - oldx[k];
+		double dy = kseedsy[k] - oldy[k];
+		if( dx*dx + dy*dy > maxshift2 ) maxshift2 = dx*dx + dy*dy;
+	}}
+
+	int changed(0);
+	#pragma omp parallel for num_threads(m_numthreads) reduction(+:changed) if(m_numthreads > 1)
+	for( int i = 0; i < sz; i++ )
+	{
+		if( prevlabels[i] != klabels[i] )
+		{
+			prevlabels[i] = klabels[i];
+			changed++;
+		}
+	}
+
+	return maxshift2 <= m_convshift*m_convshift && changed <= m_convchanged*sz;
+}
+
+//===========================================================================
+///	BuildSeedNeighbours
+///
+/// The seeds are bucketed into square cells of side radius, so only the
+/// 3x3 cells around a seed need to be searched.
+//===========================================================================
+void SLIC::BuildSeedNeighbours(
+	const vector<double>&		kseedsx,
+	const vector<double>&		kseedsy,
+	const int&					radius,
+	vector< vector<int> >&		neighbours)
+{
+	const int numk = kseedsx.size();
+	const int cellsx = m_width/radius + 1;
+	const int cellsy = m_height/radius + 1;
+	vector< vector<int> > cells(cellsx*cellsy);
+	vector<int> seedcell(numk);
+	{for( int n = 0; n < numk; n++ )
+	{
+		int cx = int(kseedsx[n])/radius;
+		int cy = int(kseedsy[n])/radius;
+		if( cx < 0 ) cx = 0; else if( cx >= cellsx ) cx = cellsx-1;
+		if( cy < 0 ) cy = 0; else if( cy >= cellsy ) cy = cellsy-1;
+		seedcell[n] = cy*cellsx + cx;
+		cells[seedcell[n]].push_back(n);
+	}}
+
+	neighbours.assign(numk, vector<int>());
+	{for( int n = 0; n < numk; n++ )
+	{
+		const int cx = seedcell[n]%cellsx;
+		const int cy = seedcell[n]/cellsx;
+		for( int y = cy-1; y <= cy+1; y++ )
+		{
+			if( y < 0 || y >= cellsy ) continue;
+			for( int x = cx-1; x <= cx+1; x++ )
+			{
+				if( x < 0 || x >= cellsx ) continue;
+				const vector<int>& cell = cells[y*cellsx + x];
+				for( int c = 0; c < int(cell.size()); c++ )
+				{
+					const int m = cell[c];
+					if( m != n && fabs(kseedsx[m] - kseedsx[n]) < radius && fabs(kseedsy[m] - kseedsy[n]) < radius )
+						neighbours[n].push_back(m);
+				}
+			}
+		}
+	}}
+}
+
+//===========================================================================
+///	SeedsDrifted
+///
+/// True if a seed moved more than maxshift pixels (in x or y) away from
+/// where the neighbour lists were built.
+//===========================================================================
+bool SLIC::SeedsDrifted(
+	const vector<double>&		nbx,
+	const vector<double>&		nby,
+	const vector<double>&		kseedsx,
+	const vector<double>&		kseedsy,
+	const double&				maxshift)
+{
+	const int numk = kseedsx.size();
+	{for( int n = 0; n < numk; n++ )
+	{
+		if( fabs(kseedsx[n] - nbx[n]) > maxshift || fabs(kseedsy[n] - nby[n]) > maxshift ) return true;
+	}}
+	return false;
+}
+
+//===========================================================================
+///	UpdateActiveSeeds
+//===========================================================================
+void SLIC::UpdateActiveSeeds(
+	const int*					klabels,
+	const vector<double>&		maxlab,
+	const vector< vector<int> >&	neighbours,
+	vector<int>&				lastlabels,
+	vector<double>&				lastmaxlab,
+	vector<char>&				moved,
+	vector<char>&				active)
+{
+	const int sz = m_width*m_height;
+	const int numk = maxlab.size();
+
+	moved.assign(numk, 0);
+	{for( int i = 0; i < sz; i++ )
+	{
+		if( klabels[i] != lastlabels[i] )
+		{
+			if( lastlabels[i] >= 0 ) moved[lastlabels[i]] = 1;
+			moved[klabels[i]] = 1;
+			lastlabels[i] = klabels[i];
+		}
+	}}
+	{for( int k = 0; k < numk; k++ )
+	{
+		if( maxlab[k] != lastmaxlab[k] ) moved[k] = 1;
+		lastmaxlab[k] = maxlab[k];
+	}}
+
+	{for( int k = 0; k < numk; k++ )
+	{
+		active[k] = moved[k];
+		for( int c = 0; c < int(neighbours[k].size()) && !active[k]; c++ )
+			active[k] = moved[neighbours[k][c]];
+	}}
+}
+
+//===========================================================================
+///	GetTileRows
+///
+/// Splits the image into numtiles horizontal tiles of (almost) equal height.
+//===========================================================================
+void SLIC::GetTileRows(
+	const int&					t,
+	const int&					numtiles,
+	int&						r1,
+	int&						r2)
+{
+	r1 = (t*m_height)/numtiles;
+	r2 = ((t+1)*m_height)/numtiles;
+}
+
+//===========================================================================
+///	AssignSeeds_Tiled
+///
+/// Every pixel belongs to exactly one tile, and within a tile the seeds are
+/// visited in the same ascending order as in the serial loop. The winning
+/// label, distvec, and the last written distlab/distxy of each pixel are
+/// therefore identical to the serial pass.
+//===========================================================================
+void SLIC::AssignSeeds_Tiled(
+	const vector<double>&		kseedsl,
+	const vector<double>&		kseedsa,
+	const vector<double>&		kseedsb,
+	const vector<double>&		kseedsx,
+	const vector<double>&		kseedsy,
+	const vector<double>&		maxlab,
+	const double&				invxywt,
+	const int&					offset,
+	int*						klabels,
+	vector<double>&				distlab,
+	vector<double>&				distxy,
+	vector<double>&				distvec,
+	const vector<char>*			active)
+{
+	const int numk = kseedsl.size();
+	const int numtiles = min(m_height, 4*m_numthreads);
+
+	vector<int> rowtile(m_height);
+	{for( int t = 0; t < numtiles; t++ )
+	{
+		int r1, r2;
+		GetTileRows(t, numtiles, r1, r2);
+		for( int y = r1; y < r2; y++ ) rowtile[y] = t;
+	}}
+	//-----------------------------------------------------------------
+	// Bucket the seeds by the tiles their search windows overlap
+	//-----------------------------------------------------------------
+	vector< vector<int> > tileseeds(numtiles);
+	{for( int n = 0; n < numk; n++ )
+	{
+		if( active && !(*active)[n] ) continue;
+		int y1 = max(0,			kseedsy[n]-offset);
+		int y2 = min(m_height,	kseedsy[n]+offset);
+		if( y1 >= y2 ) continue;
+		for( int t = rowtile[y1]; t <= rowtile[y2-1]; t++ ) tileseeds[t].push_back(n);
+	}}
+
+	#pragma omp parallel for num_threads(m_numthreads) schedule(dynamic)
+	for( int t = 0; t < numtiles; t++ )
+	{
+		int r1, r2;
+		GetTileRows(t, numtiles, r1, r2);
+		const vector<int>& seeds = tileseeds[t];
+
+		for( int s = 0; s < int(seeds.size()); s++ )
+		{
+			const int n = seeds[s];
+			int y1 = max(0,			kseedsy[n]-offset);
+			int y2 = min(m_height,	kseedsy[n]+offset);
+			int x1 = max(0,			kseedsx[n]-offset);
+			int x2 = min(m_width,	kseedsx[n]+offset);
+			if( y1 < r1 ) y1 = r1;
+			if( y2 > r2 ) y2 = r2;
+
+			for( int y = y1; y < y2; y++ )
+			{
+				for( int x = x1; x < x2; x++ )
+				{
+					int i = y*m_width + x;
+
+					double l = m_lvec[i];
+					double a = m_avec[i];
+					double b = m_bvec[i];
+
+					distlab[i] =	(l - kseedsl[n])*(l - kseedsl[n]) +
+									(a - kseedsa[n])*(a - kseedsa[n]) +
+									(b - kseedsb[n])*(b - kseedsb[n]);
+
+					distxy[i] =		(x - kseedsx[n])*(x - kseedsx[n]) +
+									(y - kseedsy[n])*(y - kseedsy[n]);
+
+					double dist = distlab[i]/maxlab[n] + distxy[i]*invxywt;
+
+					if( dist < distvec[i] )
+					{
+						distvec[i] = dist;
+						klabels[i]  = n;
+					}
+				}
+			}
+		}
+	}
+}
+
+//===========================================================================
+///	AccumulateSeeds_Tiled
+///
+/// A seed only labels pixels inside its own search window, so scanning that
+/// window in raster order adds the same values in the same order as the
+/// serial full-image pass. Pixels left unlabelled by every window keep a
+/// stale label that may lie outside the window; this is detected by the
+/// cluster sizes not summing to the image size.
+//===========================================================================
+template<typename T>
+bool SLIC::AccumulateSeeds_Tiled(
+	const T*					lvec,
+	const T*					avec,
+	const T*					bvec,
+	const vector<double>&		kseedsx,
+	const vector<double>&		kseedsy,
+	const int&					offset,
+	const int*					klabels,
+	const T*					distlab,
+	const T*					distxy,
+	vector<T>&					maxlab,
+	vector<T>&					maxxy,
+	vector<double>&				sigmal,
+	vector<double>&				sigmaa,
+	vector<double>&				sigmab,
+	vector<double>&				sigmax,
+	vector<double>&				sigmay,
+	vector<int>&				clustersize)
+{
+	const int numk = kseedsx.size();
+	const int numtiles = min(m_height, 4*m_numthreads);
+
+	vector<int> rowtile(m_height);
+	{for( int t = 0; t < numtiles; t++ )
+	{
+		int r1, r2;
+		GetTileRows(t, numtiles, r1, r2);
+		for( int y = r1; y < r2; y++ ) rowtile[y] = t;
+	}}
+	//-----------------------------------------------------------------
+	// Each tile owns the seeds whose centre lies in it
+	//-----------------------------------------------------------------
+	vector< vector<int> > tileseeds(numtiles);
+	{for( int n = 0; n < numk; n++ )
+	{
+		int cy = kseedsy[n];
+		if( cy < 0 ) cy = 0;
+		if( cy > m_height-1 ) cy = m_height-1;
+		tileseeds[rowtile[cy]].push_back(n);
+	}}
+
+	int total(0);
+	#pragma omp parallel for num_threads(m_numthreads) schedule(dynamic) reduction(+:total)
+	for( int t = 0; t < numtiles; t++ )
+	{
+		const vector<int>& seeds = tileseeds[t];
+
+		for( int s = 0; s < int(seeds.size()); s++ )
+		{
+			const int n = seeds[s];
+			int y1 = max(0,			kseedsy[n]-offset);
+			int y2 = min(m_height,	kseedsy[n]+offset);
+			int x1 = max(0,			kseedsx[n]-offset);
+			int x2 = min(m_width,	kseedsx[n]+offset);
+
+			for( int y = y1; y < y2; y++ )
+			{
+				for( int x = x1; x < x2; x++ )
+				{
+					int i = y*m_width + x;
+					if( klabels[i] != n ) continue;
+
+					if(maxlab[n] < distlab[i]) maxlab[n] = distlab[i];
+					if(distxy && maxxy[n] < distxy[i]) maxxy[n] = distxy[i];
+
+					sigmal[n] += lvec[i];
+					sigmaa[n] += avec[i];
+					sigmab[n] += bvec[i];
+					sigmax[n] += x;
+					sigmay[n] += y;
+
+					clustersize[n]++;
+				}
+			}
+			total += clustersize[n];
+		}
+	}
+	return (total == m_width*m_height);
+}
+
+//===========================================================================
+///	SaveSuperpixelLabels
+///
+///	Save labels in raster scan order.
+//===========================================================================
+void SLIC::SaveSuperpixelLabels(
+	const int*					labels,
+	const int&					width,
+	const int&					height,
+	const string&				filename,
+	const string&				path) 
+{
+	int sz = width*height;
+
+	char fname[_MAX_FNAME];
+	char extn[_MAX_FNAME];
+	_splitpath(filename.c_str(), NULL, NULL, fname, extn);
+	string temp = fname;
+
+	ofstream outfile;
+	string finalpath = path + temp + string(".dat");
+	outfile.open(finalpath.c_str(), ios::binary);
+	for( int i = 0; i < sz; i++ )
+	{
+		outfile.write((const char*)&labels[i], sizeof(int));
+	}
+	outfile.close();
+}
+
+//===========================================================================
+///	FindComponentRoot
+///
+/// Root of pixel i in the union-find forest of EnforceLabelConnectivity.
+/// Every parent index is smaller than its child, so a root is the first
+/// pixel of its component in raster order.
+//===========================================================================
+static inline int FindComponentRoot(int* parent, int i)
+{
+	int r = i;
+	while( parent[r] != r ) r = parent[r];
+	while( parent[i] != r ) { int next = parent[i]; parent[i] = r; i = next; }
+	return r;
+}
+
+static inline void UniteComponents(int* parent, int i, int j)
+{
+	int ri = FindComponentRoot(parent, i);
+	int rj = FindComponentRoot(parent, j);
+	if( ri < rj ) parent[rj] = ri;
+	else if( rj < ri ) parent[ri] = rj;
+}
+
+//===========================================================================
+///	EnforceLabelConnectivity
+///
+///		1. finding an adjacent label for each new component at the start
+///		2. if a certain component is too small, assigning the previously found
+///		    adjacent label to this component, and not incrementing the label.
+///
+/// The components are found with a union-find over horizontal tiles, one per
+/// thread, whose seams are merged afterwards. Steps 1 and 2 then visit the
+/// components in the raster order of their first pixel, as the flood fill
+/// did, so the output is the same for any number of threads. nlabels may
+/// be labels itself. With keepedges, components touching the first or last
+/// row count as large, since they may continue in a neighbouring strip.
+//===========================================================================
+void SLIC::EnforceLabelConnectivity(
+	const int*					labels,//input labels that need to be corrected to remove stray labels
+	const int&					width,
+	const int&					height,
+	int*						nlabels,//new labels
+	int&						numlabels,//the number of labels changes in the end if segments are removed
+	const int&					K, //the number of superpixels desired by the user
+	const bool&					keepedges)
+{
+	const int sz = width*height;
+	const int SUPSZ = sz/K;
+	numlabels = 0;
+	if( sz == 0 ) return;
+
+	const int numtiles = min(height, m_numthreads);
+	int* parent = new int[sz];
+	//-------------------------------------------------------
+	// Connected components of each tile, flattened so that
+	// every pixel points at its tile-local root
+	//-------------------------------------------------------
+	#pragma omp parallel for num_threads(numtiles) if(numtiles > 1)
+	for( int t = 0; t < numtiles; t++ )
+	{
+		const int r1 = height*t/numtiles;
+		const int r2 = height*(t+1)/numtiles;
+		for( int y = r1; y < r2; y++ )
+		{
+			int i = y*width;
+			for( int x = 0; x < width; x++, i++ )
+			{
+				parent[i] = i;
+				if( x > 0 && labels[i] == labels[i-1] ) UniteComponents(parent, i, i-1);
+				if( y > r1 && labels[i] == labels[i-width] ) UniteComponents(parent, i, i-width);
+			}
+		}
+		for( int i = r1*width; i < r2*width; i++ ) parent[i] = parent[parent[i]];
+	}
+	//-------------------------------------------------------
+	// Merge across the seams; only tile roots change here
+	//-------------------------------------------------------
+	{for( int t = 1; t < numtiles; t++ )
+	{
+		const int y = height*t/numtiles;
+		for( int i = y*width; i < (y+1)*width; i++ )
+		{
+			if( labels[i] == labels[i-width] ) UniteComponents(parent, parent[i], parent[i-width]);
+		}
+	}}
+	//-------------------------------------------------------
+	// Final roots and component sizes. labels is not read
+	// past this point, so nlabels may overwrite it.
+	//-------------------------------------------------------
+	int* count = new int[sz];
+	vector< vector<int> > tileroots(numtiles);
+	#pragma omp parallel num_threads(numtiles) if(numtiles > 1)
+	{
+		#pragma omp for
+		for( int t = 0; t < numtiles; t++ )
+		{
+			const int i1 = height*t/numtiles*width;
+			const int i2 = height*(t+1)/numtiles*width;
+			for( int i = i1; i < i2; i++ )
+			{
+				int r = parent[i];
+				while( parent[r] != r ) r = parent[r];
+				nlabels[i] = r;
+				count[i] = 0;
+				if( r == i ) tileroots[t].push_back(i);
+			}
+		}
+		#pragma omp for
+		for( int t = 0; t < numtiles; t++ )
+		{
+			const int i1 = height*t/numtiles*width;
+			const int i2 = height*(t+1)/numtiles*width;
+			// one atomic add per run of equal roots; a root may be shared by several tiles
+			for( int i = i1; i < i2; )
+			{
+				const int r = nlabels[i];
+				int run(0);
+				for( ; i < i2 && nlabels[i] == r; i++ ) run++;
+				#pragma omp atomic
+				count[r] += run;
+			}
+		}
+	}
+	delete [] parent;
+	if( keepedges )
+	{
+		{for( int x = 0; x < width; x++ ) count[nlabels[x]] = sz;}
+		{for( int x = sz-width; x < sz; x++ ) count[nlabels[x]] = sz;}
+	}
+	//-------------------------------------------------------
+	// Number the components in raster order. count[r] is
+	// replaced by the final label of the component rooted
+	// at r, which later components read as adjacent label.
+	//-------------------------------------------------------
+	int label(0);
+	int adjlabel(0);//adjacent label
+	{for( int t = 0; t < numtiles; t++ )
+	{
+		const vector<int>& roots = tileroots[t];
+		for( int n = 0; n < int(roots.size()); n++ )
+		{
+			const int r = roots[n];
+			const int x = r%width;
+			//-------------------------------------------------------
+			// An adjacent label comes from a neighbour in a component
+			// numbered before this one: left, up, right, down, the
+			// last one found wins
+			//-------------------------------------------------------
+			int q;
+			if( x > 0 && (q = nlabels[r-1]) < r ) adjlabel = count[q];
+			if( r >= width && (q = nlabels[r-width]) < r ) adjlabel = count[q];
+			if( x+1 < width && (q = nlabels[r+1]) < r ) adjlabel = count[q];
+			if( r+width < sz && (q = nlabels[r+width]) < r ) adjlabel = count[q];
+
+			//-------------------------------------------------------
+			// If segment size is less then a limit, assign an
+			// adjacent label found before, and decrement label count.
+			//-------------------------------------------------------
+			if( count[r] <= SUPSZ >> 2 ) count[r] = adjlabel;
+			else count[r] = label++;
+		}
+	}}
+	numlabels = label;
+
+	#pragma omp parallel for num_threads(numtiles) if(numtiles > 1)
+	for( int t = 0; t < numtiles; t++ )
+	{
+		const int i1 = height*t/numtiles*width;
+		const int i2 = height*(t+1)/numtiles*width;
+		for( int i = i1; i < i2; i++ ) nlabels[i] = count[nlabels[i]];
+	}
+	delete [] count;
+}
+
+//===========================================================================
+///	PerformSLICO_ForGivenStepSize
+///
+/// There is option to save the labels if needed.
+//===========================================================================
+void SLIC::PerformSLICO_ForGivenStepSize(
+	const unsigned int*			ubuff,
 	const int					width,
 	const int					height,
 	int*						klabels,
@@ -849,21 +1739,17 @@ void SLIC::PerformSLICO_ForGivenStepSize(
 	//klabels = new int[sz];
 	for( int s = 0; s < sz; s++ ) klabels[s] = -1;
 	//--------------------------------------------------
-	DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
+	if(!m_extlab) DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
 	//--------------------------------------------------
 
 	bool perturbseeds(true);
-	vector<double> edgemag(0);
-	if(perturbseeds) DetectLabEdges(m_lvec, m_avec, m_bvec, m_width, m_height, edgemag);
-	GetLABXYSeeds_ForGivenStepSize(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, STEP, perturbseeds, edgemag);
+	vector<double> edgemag(0);//empty: PerturbSeeds evaluates gradients lazily
+	GetLABXYSeeds_ForGivenStepSize(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, STEP, perturbseeds, m_extedges ? *m_extedges : edgemag);
 
 	PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,10);
 	numlabels = kseedsl.size();
 
-	int* nlabels = new int[sz];
-	EnforceLabelConnectivity(klabels, m_width, m_height, nlabels, numlabels, double(sz)/double(STEP*STEP));
-	{for(int i = 0; i < sz; i++ ) klabels[i] = nlabels[i];}
-	if(nlabels) delete [] nlabels;
+	EnforceLabelConnectivity(klabels, m_width, m_height, klabels, numlabels, double(sz)/double(STEP*STEP));
 }
 
 //===========================================================================
@@ -894,7 +1780,11 @@ void SLIC::PerformSLICO_ForGivenK(
 	//if(0 == klabels) klabels = new int[sz];
 	for( int s = 0; s < sz; s++ ) klabels[s] = -1;
 	//--------------------------------------------------
-	if(1)//LAB
+	if(m_extlab)
+	{
+		//planes given by SetLABPlanes
+	}
+	else if(1)//LAB
 	{
 		DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
 	}
@@ -911,17 +1801,341 @@ void SLIC::PerformSLICO_ForGivenK(
 	//--------------------------------------------------
 
 	bool perturbseeds(true);
-	vector<double> edgemag(0);
-	if(perturbseeds) DetectLabEdges(m_lvec, m_avec, m_bvec, m_width, m_height, edgemag);
-	GetLABXYSeeds_ForGivenK(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, K, perturbseeds, edgemag);
+	vector<double> edgemag(0);//empty: PerturbSeeds evaluates gradients lazily
+	GetLABXYSeeds_ForGivenK(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, K, perturbseeds, m_extedges ? *m_extedges : edgemag);
 
 	int STEP = sqrt(double(sz)/double(K)) + 2.0;//adding a small value in the even the STEP size is too small.
 	//PerformSuperpixelSLIC(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, klabels, STEP, edgemag, m);
 	PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,10);
 	numlabels = kseedsl.size();
 
-	int* nlabels = new int[sz];
-	EnforceLabelConnectivity(klabels, m_width, m_height, nlabels, numlabels, K);
-	{for(int i = 0; i < sz; i++ ) klabels[i] = nlabels[i];}
-	if(nlabels) delete [] nlabels;
-}
\ No newline at end of file
+	EnforceLabelConnectivity(klabels, m_width, m_height, klabels, numlabels, K);
+}
+
+//===========================================================================
+///	PerformSLICO_ForNextFrame
+///
+/// The seeds and labels are kept before EnforceLabelConnectivity, so the
+/// next frame resumes the clustering itself rather than its cleaned-up
+/// output. A seed left without pixels keeps its previous values instead of
+/// collapsing to the origin.
+//===========================================================================
+void SLIC::PerformSLICO_ForNextFrame(
+	const unsigned int*			ubuff,
+	const int					width,
+	const int					height,
+	int*						klabels,
+	int&						numlabels,
+	const int&					STEP,
+	const int&					numitr)
+{
+	const bool warm = !m_streamlabels.empty() && width == m_width && height == m_height && STEP == m_streamstep;
+
+	m_width  = width;
+	m_height = height;
+	int sz = m_width*m_height;
+	//--------------------------------------------------
+	if(!m_extlab)
+	{
+		if(m_lvec) delete [] m_lvec;
+		if(m_avec) delete [] m_avec;
+		if(m_bvec) delete [] m_bvec;
+		DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
+	}
+	//--------------------------------------------------
+	vector<double> kseedsl(0);
+	vector<double> kseedsa(0);
+	vector<double> kseedsb(0);
+	vector<double> kseedsx(0);
+	vector<double> kseedsy(0);
+	if( warm )
+	{
+		kseedsl = m_streamseedsl;
+		kseedsa = m_streamseedsa;
+		kseedsb = m_streamseedsb;
+		kseedsx = m_streamseedsx;
+		kseedsy = m_streamseedsy;
+		{for( int i = 0; i < sz; i++ ) klabels[i] = m_streamlabels[i];}
+		PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,numitr);
+	}
+	else
+	{
+		{for( int s = 0; s < sz; s++ ) klabels[s] = -1;}
+		vector<double> edgemag(0);//empty: PerturbSeeds evaluates gradients lazily
+		GetLABXYSeeds_ForGivenStepSize(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, STEP, true, m_extedges ? *m_extedges : edgemag);
+		PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,10);
+	}
+	const int numk = kseedsl.size();
+
+	if( warm )
+	{
+		vector<int> seedsize(numk, 0);
+		{for( int i = 0; i < sz; i++ ) if( klabels[i] >= 0 ) seedsize[klabels[i]]++;}
+		{for( int k = 0; k < numk; k++ )
+		{
+			if( seedsize[k] > 0 ) continue;
+			kseedsl[k] = m_streamseedsl[k];
+			kseedsa[k] = m_streamseedsa[k];
+			kseedsb[k] = m_streamseedsb[k];
+			kseedsx[k] = m_streamseedsx[k];
+			kseedsy[k] = m_streamseedsy[k];
+		}}
+	}
+	m_streamseedsl.swap(kseedsl);
+	m_streamseedsa.swap(kseedsa);
+	m_streamseedsb.swap(kseedsb);
+	m_streamseedsx.swap(kseedsx);
+	m_streamseedsy.swap(kseedsy);
+	m_streamlabels.assign(klabels, klabels + sz);
+	m_streamstep = STEP;
+
+	EnforceLabelConnectivity(klabels, m_width, m_height, klabels, numlabels, double(sz)/double(STEP*STEP));
+	RelabelBySeeds(m_streamlabels, numk, klabels, numlabels);
+}
+
+//===========================================================================
+///	ResetStream
+//===========================================================================
+void SLIC::ResetStream()
+{
+	m_streamseedsl.clear();
+	m_streamseedsa.clear();
+	m_streamseedsb.clear();
+	m_streamseedsx.clear();
+	m_streamseedsy.clear();
+	m_streamlabels.clear();
+	m_streamstep = 0;
+}
+
+//===========================================================================
+///	RelabelBySeeds
+//===========================================================================
+void SLIC::RelabelBySeeds(
+	const vector<int>&			seedlabels,
+	const int&					numseeds,
+	int*						klabels,
+	int&						numlabels)
+{
+	const int sz = seedlabels.size();
+	vector<int> seedof(numlabels, -1);
+	vector<char> claimed(numseeds, 0);
+	int next(numseeds);
+	int maxlabel(-1);
+	for( int i = 0; i < sz; i++ )
+	{
+		int& seed = seedof[klabels[i]];
+		if( seed < 0 )
+		{
+			const int k = seedlabels[i];
+			if( k >= 0 && !claimed[k] )
+			{
+				seed = k;
+				claimed[k] = 1;
+			}
+			else seed = next++;
+			if( seed > maxlabel ) maxlabel = seed;
+		}
+		klabels[i] = seed;
+	}
+	numlabels = maxlabel + 1;
+}
+
+//===========================================================================
+///	PerformSLICO_ForStrips
+///
+/// The core rows [y0, y1) of a strip are clustered together with a halo of
+/// 2*offset + STEP rows above and below, which holds every seed that can
+/// reach the core and the pixels those seeds are averaged over. Seed rows
+/// are created when they first enter a window and dropped once no later
+/// window can contain them. Seeds above y0 were finished by the previous
+/// strip and stay fixed; seeds below y1 are refined again by the next one.
+/// No seed perturbation is done, since the edge map would need the rows
+/// around every seed.
+//===========================================================================
+struct SLICSeedRow
+{
+	vector<double> l, a, b, x, y;
+};
+
+bool SLIC::PerformSLICO_ForStrips(
+	SLICRowSource&				source,
+	SLICLabelSink&				sink,
+	int&						numlabels,
+	const int&					STEP,
+	const int&					striprows)
+{
+	const int width = source.Width();
+	const int height = source.Height();
+	numlabels = 0;
+	if( width <= 0 || height <= 0 || STEP <= 0 ) return false;
+
+	int offset = STEP;
+	if(STEP < 10) offset = STEP*1.5;
+	const int halo = 2*offset + STEP;
+	const int corerows = striprows > STEP ? striprows : STEP;
+
+	//--------------------------------------------------
+	// Global seed grid, as in GetLABXYSeeds_ForGivenStepSize
+	//--------------------------------------------------
+	int xstrips = (0.5+double(width)/double(STEP));
+	int ystrips = (0.5+double(height)/double(STEP));
+	if( xstrips < 1 ) xstrips = 1;
+	if( ystrips < 1 ) ystrips = 1;
+	const double xerrperstrip = double(width - STEP*xstrips)/double(xstrips);
+	const double yerrperstrip = double(height - STEP*ystrips)/double(ystrips);
+	const int xoff = STEP/2;
+	const int yoff = STEP/2;
+	vector<int> gridx(xstrips);
+	{for( int gx = 0; gx < xstrips; gx++ )
+	{
+		gridx[gx] = gx*STEP + xoff + int(gx*xerrperstrip);
+		if( gridx[gx] >= width ) gridx[gx] = width-1;
+	}}
+	vector<int> gridy(ystrips);
+	{for( int gy = 0; gy < ystrips; gy++ )
+	{
+		gridy[gy] = gy*STEP + yoff + int(gy*yerrperstrip);
+		if( gridy[gy] >= height ) gridy[gy] = height-1;
+	}}
+
+	vector<SLICSeedRow> seedrows(ystrips);	// only the rows near the current strip are filled
+	vector<unsigned int> argb;
+	vector<int> klabels;
+	int firstrow(0);						// first seed row that is still kept
+	int nextlabel = xstrips*ystrips;		// labels for superpixels split by the connectivity pass
+	int maxlabel(-1);
+
+	// every strip is converted here, so planes given by SetLABPlanes are
+	// forgotten (not freed) and the strip planes are owned by this object
+	if(m_extlab)
+	{
+		m_lvec = m_avec = m_bvec = NULL;
+		m_extlab = false;
+		m_extedges = NULL;
+	}
+
+	for( int y0 = 0; y0 < height; y0 += corerows )
+	{
+		const int y1 = y0 + corerows < height ? y0 + corerows : height;
+		const int wy0 = y0 - halo > 0 ? y0 - halo : 0;
+		const int wy1 = y1 + halo < height ? y1 + halo : height;
+		m_width  = width;
+		m_height = wy1 - wy0;
+		const int sz = m_width*m_height;
+
+		argb.resize(sz);
+		if( !source.ReadRows(wy0, m_height, &argb[0]) ) return false;
+		const unsigned int* ubuff = &argb[0];
+		if(m_lvec) delete [] m_lvec;
+		if(m_avec) delete [] m_avec;
+		if(m_bvec) delete [] m_bvec;
+		DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
+
+		//--------------------------------------------------
+		// Seeds of the rows inside the window, in window coordinates
+		//--------------------------------------------------
+		int gy1(firstrow), gy2(firstrow);
+		while( gy1 < ystrips && gridy[gy1] < wy0 ) gy1++;
+		gy2 = gy1;
+		while( gy2 < ystrips && gridy[gy2] < wy1 ) gy2++;
+		for( int gy = firstrow; gy < gy1; gy++ ) seedrows[gy] = SLICSeedRow();
+		firstrow = gy1;
+
+		vector<double> kseedsl, kseedsa, kseedsb, kseedsx, kseedsy;
+		vector<char> fixed;
+		for( int gy = gy1; gy < gy2; gy++ )
+		{
+			SLICSeedRow& row = seedrows[gy];
+			if( row.x.empty() )
+			{
+				const int i0 = (gridy[gy] - wy0)*m_width;
+				for( int gx = 0; gx < xstrips; gx++ )
+				{
+					row.l.push_back(m_lvec[i0 + gridx[gx]]);
+					row.a.push_back(m_avec[i0 + gridx[gx]]);
+					row.b.push_back(m_bvec[i0 + gridx[gx]]);
+					row.x.push_back(gridx[gx]);
+					row.y.push_back(gridy[gy]);
+				}
+			}
+			for( int gx = 0; gx < xstrips; gx++ )
+			{
+				kseedsl.push_back(row.l[gx]);
+				kseedsa.push_back(row.a[gx]);
+				kseedsb.push_back(row.b[gx]);
+				kseedsx.push_back(row.x[gx]);
+				kseedsy.push_back(row.y[gx] - wy0);
+				fixed.push_back(gridy[gy] < y0);
+			}
+		}
+		const int numk = kseedsl.size();
+		if( numk == 0 ) return false;
+
+		//--------------------------------------------------
+		// Every pixel starts at its nearest grid seed, so pixels no
+		// search window reaches still carry a valid label
+		//--------------------------------------------------
+		klabels.resize(sz);
+		{for( int y = 0; y < m_height; y++ )
+		{
+			int gy = gy1;
+			while( gy+1 < gy2 && gridy[gy+1] <= y + wy0 ) gy++;
+			int gx = 0;
+			for( int x = 0; x < m_width; x++ )
+			{
+				while( gx+1 < xstrips && gridx[gx+1] <= x ) gx++;
+				klabels[y*m_width + x] = (gy - gy1)*xstrips + gx;
+			}
+		}}
+
+		m_fixedseeds = &fixed;
+		PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,&klabels[0],STEP,10);
+		m_fixedseeds = NULL;
+
+		{for( int gy = gy1; gy < gy2; gy++ )
+		{
+			SLICSeedRow& row = seedrows[gy];
+			for( int gx = 0; gx < xstrips; gx++ )
+			{
+				const int k = (gy - gy1)*xstrips + gx;
+				if( fixed[k] ) continue;
+				row.l[gx] = kseedsl[k];
+				row.a[gx] = kseedsa[k];
+				row.b[gx] = kseedsb[k];
+				row.x[gx] = kseedsx[k];
+				row.y[gx] = kseedsy[k] + wy0;
+			}
+		}}
+
+		//--------------------------------------------------
+		// Connectivity of the core rows, then global labels
+		//--------------------------------------------------
+		int* core = &klabels[(y0 - wy0)*m_width];
+		const int coreh = y1 - y0;
+		const int coresz = coreh*m_width;
+		vector<int> seedlabels(core, core + coresz);
+		int K = double(coresz)/double(STEP*STEP);
+		if( K < 1 ) K = 1;
+		int corelabels(0);
+		EnforceLabelConnectivity(core, m_width, coreh, core, corelabels, K, true);
+		RelabelBySeeds(seedlabels, numk, core, corelabels);
+
+		int numsplit(0);
+		{for( int i = 0; i < coresz; i++ )
+		{
+			const int k = core[i];
+			if( k < numk ) core[i] = gy1*xstrips + k;
+			else
+			{
+				core[i] = nextlabel + k - numk;
+				if( k - numk + 1 > numsplit ) numsplit = k - numk + 1;
+			}
+			if( core[i] > maxlabel ) maxlabel = core[i];
+		}}
+		nextlabel += numsplit;
+
+		if( !sink.WriteRows(y0, coreh, core) ) return false;
+	}
+	numlabels = maxlabel + 1;
+	return true;
+}
@@ -30,6 +30,28 @@
 #include <algorithm>
 using namespace std;
 
+//============================================================================
+// Row-wise image input and label output of PerformSLICO_ForStrips, so that
+// images larger than memory can be read from and written to files.
+//============================================================================
+class SLICRowSource
+{
+public:
+	virtual ~SLICRowSource() {}
+	virtual int Width() const = 0;
+	virtual int Height() const = 0;
+	// rows [y, y+rows) as ARGB pixels, like ubuff
+	virtual bool ReadRows(const int& y, const int& rows, unsigned int* argb) = 0;
+};
+
+class SLICLabelSink
+{
+public:
+	virtual ~SLICLabelSink() {}
+	// rows [y, y+rows), called once per strip in top-to-bottom order
+	virtual bool WriteRows(const int& y, const int& rows, const int* labels) = 0;
+};
+
 
 class SLIC  
 {
@@ -59,6 +81,44 @@ public:
 		const int&					K,
 		const double&				m);
 
+	//============================================================================
+	// Superpixels for consecutive frames of a video. The first frame, and any
+	// frame after ResetStream() or a change of size or step, is segmented as
+	// by PerformSLICO_ForGivenStepSize. Later frames start from the previous
+	// frame's seeds and labels, skip the seed perturbation, and run only
+	// numitr iterations. A superpixel is labelled by the index of its seed, so
+	// labels persist across frames; they are not contiguous, and numlabels is
+	// the largest label plus one.
+	//============================================================================
+	void PerformSLICO_ForNextFrame(
+		const unsigned int*			ubuff,
+		const int					width,
+		const int					height,
+		int*						klabels,
+		int&						numlabels,
+		const int&					STEP,
+		const int&					numitr = 2);
+	//============================================================================
+	// Out-of-core superpixel segmentation for a given step size. The image is
+	// processed in horizontal strips of striprows rows plus a halo of about
+	// 3*STEP rows on each side, so memory is bounded by the strip size rather
+	// than the image size. Seeds are laid out on one global grid; a seed
+	// finished in one strip is kept fixed while the next strip is clustered,
+	// and the labels, which are global seed indices, continue across strip
+	// borders. Lab planes given by SetLABPlanes are not used, and are
+	// forgotten. Returns false if reading or writing fails.
+	//============================================================================
+	bool PerformSLICO_ForStrips(
+		SLICRowSource&				source,
+		SLICLabelSink&				sink,
+		int&						numlabels,
+		const int&					STEP,
+		const int&					striprows);
+	//============================================================================
+	// Forget the state kept by PerformSLICO_ForNextFrame (e.g. at a scene cut)
+	//============================================================================
+	void ResetStream();
+
 	//============================================================================
 	// Save superpixel labels in a text file in raster scan order
 	//============================================================================
@@ -85,6 +145,78 @@ public:
 		const int&					width,
 		const int&					height);
 
+	//============================================================================
+	// Number of threads used by the tiled assignment and update steps of
+	// PerformSuperpixelSegmentation_VariableSandM (1 = serial, the default).
+	// The labels are bit-identical for any thread count.
+	//============================================================================
+	void SetNumThreads(
+		const int&					numthreads);
+	//============================================================================
+	// Select the single-precision SIMD kernel (SSE2/AVX) for the iterations of
+	// PerformSuperpixelSegmentation_VariableSandM instead of the double one.
+	// Results are close to, but not bit-identical with, the double kernel.
+	// The float kernel always runs the exhaustive update; SetPreemptive()
+	// has no effect on it.
+	//============================================================================
+	void SetFloatKernel(
+		const bool&					usefloat);
+	//============================================================================
+	// Stop the iterations early once, in one iteration, no seed moved more
+	// than maxshift pixels and at most a fraction maxchanged of the pixels
+	// changed label. The usual 10 iterations remain the upper bound. Both
+	// tolerances <= 0 (the default) always run all iterations.
+	//============================================================================
+	void SetConvergence(
+		const double&				maxshift,
+		const double&				maxchanged);
+	//============================================================================
+	// Preemptive (active-cluster) iterations for the double kernel: a seed is
+	// scanned and updated only if its own pixels or those of a neighbouring
+	// seed changed label in the previous iteration. Seeds in flat regions then
+	// drop out after a few iterations. Off by default (exhaustive update).
+	//============================================================================
+	void SetPreemptive(
+		const bool&					preemptive);
+	//============================================================================
+	// Number of iterations run by the last segmentation call
+	//============================================================================
+	int GetNumIterations() const { return m_numitr; }
+	//============================================================================
+	// Use Lab planes computed elsewhere (e.g. by a FeatureCache) instead of
+	// converting ubuff, and optionally a precomputed DetectLabEdges() map. The
+	// arrays must outlive the segmentation calls; SLIC does not free them.
+	//============================================================================
+	void SetLABPlanes(
+		const double*				lvec,
+		const double*				avec,
+		const double*				bvec,
+		const vector<double>*		edgemag = NULL);
+	//============================================================================
+	// Post-processing of SLIC segmentation, to avoid stray labels. Also used
+	// by SLICN on its own label maps.
+	//============================================================================
+	void EnforceLabelConnectivity(
+		const int*					labels,
+		const int&					width,
+		const int&					height,
+		int*						nlabels,//input labels that need to be corrected to remove stray labels
+		int&						numlabels,//the number of labels changes in the end if segments are removed
+		const int&					K, //the number of superpixels desired by the user
+		const bool&					keepedges = false); //never absorb components touching the top or bottom row
+	//============================================================================
+	// Detect color edges over the whole image. PerturbSeeds() no longer needs
+	// the full map, so this is only for callers that use it themselves.
+	//============================================================================
+	static void DetectLabEdges(
+		const double*				lvec,
+		const double*				avec,
+		const double*				bvec,
+		const int&					width,
+		const int&					height,
+		vector<double>&				edges,
+		const int&					numthreads = 1);
+
 private:
 
 	//============================================================================
@@ -101,6 +233,131 @@ private:
 		const int&					STEP,
 		const int&					NUMITR);
 	//============================================================================
+	// Single-precision version of the above. The Lab planes and the distance
+	// scratch are float arrays, and the distance and arg-min update of each
+	// window row is evaluated with SSE2/AVX. The float planes are kept in the
+	// object; Lab planes SLIC converted itself are freed once copied.
+	//============================================================================
+	void PerformSuperpixelSegmentation_VariableSandM_Float(
+		vector<double>&				kseedsl,
+		vector<double>&				kseedsa,
+		vector<double>&				kseedsb,
+		vector<double>&				kseedsx,
+		vector<double>&				kseedsy,
+		int*						klabels,
+		const int&					STEP,
+		const int&					NUMITR);
+	//============================================================================
+	// Assignment step of PerformSuperpixelSegmentation_VariableSandM, run on
+	// horizontal tiles in parallel. Each tile visits, in ascending order, the
+	// seeds whose search window overlaps it, clipped to its own rows. Seeds
+	// with a zero entry in active (if given) are skipped.
+	//============================================================================
+	void AssignSeeds_Tiled(
+		const vector<double>&		kseedsl,
+		const vector<double>&		kseedsa,
+		const vector<double>&		kseedsb,
+		const vector<double>&		kseedsx,
+		const vector<double>&		kseedsy,
+		const vector<double>&		maxlab,
+		const double&				invxywt,
+		const int&					offset,
+		int*						klabels,
+		vector<double>&				distlab,
+		vector<double>&				distxy,
+		vector<double>&				distvec,
+		const vector<char>*			active);
+	//============================================================================
+	// Max distance and centroid accumulation, run on tiles in parallel. Each
+	// tile owns the seeds centred in it and scans their windows in raster order,
+	// so the sums match the serial pass exactly. Returns false if some pixel
+	// lies outside its seed's window; the caller then falls back to the serial
+	// pass. T is the precision of the Lab planes and distances; distxy may be
+	// NULL, in which case maxxy is left untouched.
+	//============================================================================
+	template<typename T>
+	bool AccumulateSeeds_Tiled(
+		const T*					lvec,
+		const T*					avec,
+		const T*					bvec,
+		const vector<double>&		kseedsx,
+		const vector<double>&		kseedsy,
+		const int&					offset,
+		const int*					klabels,
+		const T*					distlab,
+		const T*					distxy,
+		vector<T>&					maxlab,
+		vector<T>&					maxxy,
+		vector<double>&				sigmal,
+		vector<double>&				sigmaa,
+		vector<double>&				sigmab,
+		vector<double>&				sigmax,
+		vector<double>&				sigmay,
+		vector<int>&				clustersize);
+	//============================================================================
+	// Convergence test at the end of an iteration, see SetConvergence. oldx and
+	// oldy are the seed positions before the update; prevlabels holds the
+	// labels of the previous iteration and is overwritten with klabels.
+	//============================================================================
+	bool CheckConvergence(
+		const vector<double>&		oldx,
+		const vector<double>&		oldy,
+		const vector<double>&		kseedsx,
+		const vector<double>&		kseedsy,
+		const int*					klabels,
+		vector<int>&				prevlabels);
+	//============================================================================
+	// Seeds of the preemptive mode whose search windows may overlap: centres
+	// closer than radius in x and y. Built from the initial grid and rebuilt
+	// whenever SeedsDrifted() reports that the seeds have moved too far.
+	//============================================================================
+	void BuildSeedNeighbours(
+		const vector<double>&		kseedsx,
+		const vector<double>&		kseedsy,
+		const int&					radius,
+		vector< vector<int> >&		neighbours);
+	//============================================================================
+	// True if some seed is more than maxshift pixels away from (nbx,nby)
+	//============================================================================
+	bool SeedsDrifted(
+		const vector<double>&		nbx,
+		const vector<double>&		nby,
+		const vector<double>&		kseedsx,
+		const vector<double>&		kseedsy,
+		const double&				maxshift);
+	//============================================================================
+	// After an iteration of the preemptive mode: a seed has moved if a pixel
+	// changed label to or from it or its maxlab grew, and is active in the
+	// next iteration if it or one of its neighbours moved. lastlabels and
+	// lastmaxlab are updated to the current state.
+	//============================================================================
+	void UpdateActiveSeeds(
+		const int*					klabels,
+		const vector<double>&		maxlab,
+		const vector< vector<int> >&	neighbours,
+		vector<int>&				lastlabels,
+		vector<double>&				lastmaxlab,
+		vector<char>&				moved,
+		vector<char>&				active);
+	//============================================================================
+	// Gives every label of the connected map klabels the seed it came from,
+	// read from seedlabels at the first pixel of the label. A seed claimed by
+	// an earlier label is replaced by a new index past numseeds.
+	//============================================================================
+	void RelabelBySeeds(
+		const vector<int>&			seedlabels,
+		const int&					numseeds,
+		int*						klabels,
+		int&						numlabels);
+	//============================================================================
+	// Row range of tile t when the image is split into numtiles horizontal tiles
+	//============================================================================
+	void GetTileRows(
+		const int&					t,
+		const int&					numtiles,
+		int&						r1,
+		int&						r2);
+	//============================================================================
 	// Pick seeds for superpixels when step size of superpixels is given.
 	//============================================================================
 	void GetLABXYSeeds_ForGivenStepSize(
@@ -127,6 +384,7 @@ private:
 
 	//============================================================================
 	// Move the seeds to low gradient positions to avoid putting seeds at region boundaries.
+	// An empty edges vector evaluates the gradients around the seeds only.
 	//============================================================================
 	void PerturbSeeds(
 		vector<double>&				kseedsl,
@@ -136,37 +394,11 @@ private:
 		vector<double>&				kseedsy,
 		const vector<double>&		edges);
 	//============================================================================
-	// Detect color edges, to help PerturbSeeds()
-	//============================================================================
-	void DetectLabEdges(
-		const double*				lvec,
-		const double*				avec,
-		const double*				bvec,
-		const int&					width,
-		const int&					height,
-		vector<double>&				edges);
-	//============================================================================
-	// xRGB to XYZ conversion; helper for RGB2LAB()
-	//============================================================================
-	void RGB2XYZ(
-		const int&					sR,
-		const int&					sG,
-		const int&					sB,
-		double&						X,
-		double&						Y,
-		double&						Z);
-	//============================================================================
-	// sRGB to CIELAB conversion
+	// Gradient magnitude of one pixel of the current Lab planes
 	//============================================================================
-	void RGB2LAB(
-		const int&					sR,
-		const int&					sG,
-		const int&					sB,
-		double&						lval,
-		double&						aval,
-		double&						bval);
+	double LabEdgeAt(const int& ind) const;
 	//============================================================================
-	// sRGB to CIELAB conversion for 2-D images
+	// sRGB to CIELAB conversion for 2-D images (see ColorConverter)
 	//============================================================================
 	void DoRGBtoLABConversion(
 		const unsigned int*&		ubuff,
@@ -182,22 +414,33 @@ private:
 		double**&					avec,
 		double**&					bvec);
 
-	//============================================================================
-	// Post-processing of SLIC segmentation, to avoid stray labels.
-	//============================================================================
-	void EnforceLabelConnectivity(
-		const int*					labels,
-		const int&					width,
-		const int&					height,
-		int*						nlabels,//input labels that need to be corrected to remove stray labels
-		int&						numlabels,//the number of labels changes in the end if segments are removed
-		const int&					K); //the number of superpixels desired by the user
 
 
 private:
 	int										m_width;
 	int										m_height;
 	int										m_depth;
+	int										m_numthreads;
+	bool									m_floatkernel;
+	bool									m_preemptive;
+	double									m_convshift;
+	double									m_convchanged;
+	int										m_numitr;
+	bool									m_extlab;
+	const vector<double>*					m_extedges;
+	const vector<char>*						m_fixedseeds;	// seeds the iterations must not move
+	vector<float>							m_lvecf;		// float copies of the Lab planes for the float kernel
+	vector<float>							m_avecf;
+	vector<float>							m_bvecf;
+
+	// state of PerformSLICO_ForNextFrame
+	vector<double>							m_streamseedsl;
+	vector<double>							m_streamseedsa;
+	vector<double>							m_streamseedsb;
+	vector<double>							m_streamseedsx;
+	vector<double>							m_streamseedsy;
+	vector<int>								m_streamlabels;
+	int										m_streamstep;
 
 	double*									m_lvec;
 	double*									m_avec;
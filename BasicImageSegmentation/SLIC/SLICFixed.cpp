@@ -0,0 +1,392 @@
+// SLICFixed.cpp: implementation of the SLICFixed class.
+//===========================================================================
+
+#include <climits>
+#include <cmath>
+#include <mutex>
+#include "SLICFixed.h"
+#include "SLIC.h"
+
+// reciprocals are scaled by 2^Q_SHIFT
+#define Q_SHIFT 20
+
+// linear sRGB and XYZ/white are scaled by 2^LIN_SHIFT, the matrix by
+// 2^MAT_SHIFT, and f(t) is sampled every 2^F_STEP of t up to 1.25
+#define LIN_SHIFT 16
+#define MAT_SHIFT 14
+#define F_STEP 4
+#define F_SIZE (((5 << LIN_SHIFT)/4 >> F_STEP) + 2)
+
+static int s_gamma[256];		// sRGB value -> linear
+static int s_f[F_SIZE];			// CIE f(t), scaled by 2^LIN_SHIFT
+static int s_xyz[9];			// sRGB -> XYZ/white, row-major
+static std::once_flag s_tablesbuilt;
+
+static void BuildTables()
+{
+	for( int i = 0; i < 256; i++ )
+	{
+		double c = i/255.0;
+		c = (c <= 0.04045) ? c/12.92 : pow((c+0.055)/1.055, 2.4);
+		s_gamma[i] = int(c*(1 << LIN_SHIFT) + 0.5);
+	}
+	for( int i = 0; i < F_SIZE; i++ )
+	{
+		double t = double(i << F_STEP)/(1 << LIN_SHIFT);
+		double f = (t > 0.008856) ? pow(t, 1.0/3.0) : (903.3*t + 16.0)/116.0;
+		s_f[i] = int(f*(1 << LIN_SHIFT) + 0.5);
+	}
+	// as in ColorConverter, with the D65 white folded into the rows
+	const double m[9] = {
+		0.4124564/0.950456, 0.3575761/0.950456, 0.1804375/0.950456,
+		0.2126729,          0.7151522,          0.0721750,
+		0.0193339/1.088754, 0.1191920/1.088754, 0.9503041/1.088754};
+	for( int i = 0; i < 9; i++ ) s_xyz[i] = int(m[i]*(1 << MAT_SHIFT) + 0.5);
+}
+
+// f(t) for t scaled by 2^LIN_SHIFT, interpolated between the table samples
+static inline int LabF(int t)
+{
+	const int i = t >> F_STEP;
+	if( i >= F_SIZE-1 ) return s_f[F_SIZE-1];
+	const int frac = t & ((1 << F_STEP)-1);
+	return s_f[i] + (((s_f[i+1] - s_f[i])*frac) >> F_STEP);
+}
+
+static inline unsigned char Clamp8(int v)
+{
+	return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+SLICFixed::SLICFixed()
+{
+	m_numthreads = 1;
+	m_lvec = m_avec = m_bvec = NULL;
+	m_width = m_height = 0;
+}
+
+//===========================================================================
+///	ARGB2Lab
+///
+/// The tables are built with floating point once per process; the pixels
+/// go through table look-ups, integer multiply-adds and shifts only. The
+/// products stay below 2^31: linear values are at most 2^16, the matrix
+/// rows sum to about 2^14, and 500*f(t) is below 2^26.
+//===========================================================================
+void SLICFixed::ARGB2Lab(
+	const unsigned int*			ubuff,
+	const int&					n,
+	unsigned char*				lq,
+	unsigned char*				aq,
+	unsigned char*				bq)
+{
+	std::call_once(s_tablesbuilt, BuildTables);
+
+	const int half = 1 << (LIN_SHIFT-1);
+	for( int i = 0; i < n; i++ )
+	{
+		const int r = s_gamma[(ubuff[i] >> 16) & 0xFF];
+		const int g = s_gamma[(ubuff[i] >>  8) & 0xFF];
+		const int b = s_gamma[(ubuff[i]      ) & 0xFF];
+
+		const int fx = LabF((s_xyz[0]*r + s_xyz[1]*g + s_xyz[2]*b) >> MAT_SHIFT);
+		const int fy = LabF((s_xyz[3]*r + s_xyz[4]*g + s_xyz[5]*b) >> MAT_SHIFT);
+		const int fz = LabF((s_xyz[6]*r + s_xyz[7]*g + s_xyz[8]*b) >> MAT_SHIFT);
+
+		// L = 116*fy - 16, a = 500*(fx - fy), b = 200*(fy - fz), rounded,
+		// with 128 added to a and b before the shift so that it is exact
+		lq[i] = Clamp8((116*fy - (16 << LIN_SHIFT) + half) >> LIN_SHIFT);
+		aq[i] = Clamp8((500*(fx - fy) + (128 << LIN_SHIFT) + half) >> LIN_SHIFT);
+		bq[i] = Clamp8((200*(fy - fz) + (128 << LIN_SHIFT) + half) >> LIN_SHIFT);
+	}
+}
+
+//===========================================================================
+///	Edge
+//===========================================================================
+int SLICFixed::Edge(const int& x, const int& y) const
+{
+	if( x < 1 || y < 1 || x >= m_width-1 || y >= m_height-1 ) return 0;
+	const int i = y*m_width + x;
+	const int w = m_width;
+	int dl = m_lvec[i-1] - m_lvec[i+1], da = m_avec[i-1] - m_avec[i+1], db = m_bvec[i-1] - m_bvec[i+1];
+	int e = dl*dl + da*da + db*db;
+	dl = m_lvec[i-w] - m_lvec[i+w]; da = m_avec[i-w] - m_avec[i+w]; db = m_bvec[i-w] - m_bvec[i+w];
+	return e + dl*dl + da*da + db*db;
+}
+
+//===========================================================================
+///	GetSeeds
+///
+/// Same grid as SLIC::GetLABXYSeeds_ForGivenStepSize, with each seed moved
+/// to the lowest gradient of its 3x3 neighbourhood.
+//===========================================================================
+void SLICFixed::GetSeeds(
+	const int&					STEP,
+	vector<int>&				kseedsl,
+	vector<int>&				kseedsa,
+	vector<int>&				kseedsb,
+	vector<int>&				kseedsx,
+	vector<int>&				kseedsy)
+{
+	const int dx8[8] = {-1, -1,  0,  1, 1, 1, 0, -1};
+	const int dy8[8] = { 0, -1, -1, -1, 0, 1, 1,  1};
+
+	int xstrips = (0.5+double(m_width)/double(STEP));
+	int ystrips = (0.5+double(m_height)/double(STEP));
+	if( xstrips < 1 ) xstrips = 1;
+	if( ystrips < 1 ) ystrips = 1;
+	const double xerrperstrip = double(m_width - STEP*xstrips)/double(xstrips);
+	const double yerrperstrip = double(m_height - STEP*ystrips)/double(ystrips);
+	const int xoff = STEP/2;
+	const int yoff = STEP/2;
+
+	const int numseeds = xstrips*ystrips;
+	kseedsl.resize(numseeds);
+	kseedsa.resize(numseeds);
+	kseedsb.resize(numseeds);
+	kseedsx.resize(numseeds);
+	kseedsy.resize(numseeds);
+
+	int n(0);
+	for( int y = 0; y < ystrips; y++ )
+	{
+		int ye = y*yerrperstrip;
+		for( int x = 0; x < xstrips; x++, n++ )
+		{
+			int xe = x*xerrperstrip;
+			int sx = x*STEP+xoff+xe;
+			int sy = y*STEP+yoff+ye;
+			if( sx >= m_width ) sx = m_width-1;
+			if( sy >= m_height ) sy = m_height-1;
+
+			int best = Edge(sx, sy);
+			int bx(sx), by(sy);
+			for( int i = 0; i < 8; i++ )
+			{
+				int nx = sx+dx8[i];
+				int ny = sy+dy8[i];
+				if( nx >= 0 && nx < m_width && ny >= 0 && ny < m_height )
+				{
+					int e = Edge(nx, ny);
+					if( e < best ) { best = e; bx = nx; by = ny; }
+				}
+			}
+			const int i = by*m_width + bx;
+			kseedsl[n] = m_lvec[i];
+			kseedsa[n] = m_avec[i];
+			kseedsb[n] = m_bvec[i];
+			kseedsx[n] = bx;
+			kseedsy[n] = by;
+		}
+	}
+}
+
+//===========================================================================
+///	AssignRows
+///
+/// Assignment step restricted to rows [r1, r2). The colour term is at most
+/// 3*255^2 and the reciprocals are bounded (see PerformSLICO_ForGivenStepSize),
+/// so the distance fits in 32 unsigned bits. As in SLIC, distlab is written for every
+/// pixel of the window, so maxlab follows the last seed visited.
+//===========================================================================
+void SLICFixed::AssignRows(
+	const int&					r1,
+	const int&					r2,
+	const vector<int>&			seeds,
+	const vector<int>&			kseedsl,
+	const vector<int>&			kseedsa,
+	const vector<int>&			kseedsb,
+	const vector<int>&			kseedsx,
+	const vector<int>&			kseedsy,
+	const vector<unsigned int>&	invmaxlab,
+	const unsigned int&			invxywt,
+	const int&					offset,
+	int*						klabels,
+	int*						distlab,
+	unsigned int*				distvec)
+{
+	for( int s = 0; s < int(seeds.size()); s++ )
+	{
+		const int n = seeds[s];
+		int y1 = kseedsy[n]-offset;
+		int y2 = kseedsy[n]+offset;
+		int x1 = kseedsx[n]-offset;
+		int x2 = kseedsx[n]+offset;
+		if( y1 < r1 ) y1 = r1;
+		if( y2 > r2 ) y2 = r2;
+		if( x1 < 0 ) x1 = 0;
+		if( x2 > m_width ) x2 = m_width;
+
+		const int sl = kseedsl[n], sa = kseedsa[n], sb = kseedsb[n];
+		const unsigned int invlab = invmaxlab[n];
+		for( int y = y1; y < y2; y++ )
+		{
+			const int dy = y - kseedsy[n];
+			const int row = y*m_width;
+			for( int x = x1; x < x2; x++ )
+			{
+				const int i = row+x;
+				const int dl = m_lvec[i] - sl, da = m_avec[i] - sa, db = m_bvec[i] - sb;
+				const int dlab = dl*dl + da*da + db*db;
+				const int dx = x - kseedsx[n];
+				const unsigned int dist = unsigned(dlab)*invlab + unsigned(dx*dx + dy*dy)*invxywt;
+				distlab[i] = dlab;
+				if( dist < distvec[i] )
+				{
+					distvec[i] = dist;
+					klabels[i] = n;
+				}
+			}
+		}
+	}
+}
+
+//===========================================================================
+///	PerformSLICO_ForGivenStepSize
+///
+/// maxlab starts at 10^2, as in SLIC, and only grows, so invmaxlab is at
+/// most 2^20/100 and the colour term below 3*255^2*10486 < 2^31. With
+/// offset <= 1.5*STEP the spatial term is below 4.5*2^20, so the sum fits.
+/// The reciprocals are rounded, so their relative error is at most
+/// maxlab/2^21: below 1% up to maxlab = 2^14. The centroids are accumulated serially, relative
+/// to the old seed position (all members lie within offset of it), which
+/// keeps the sums small and the result independent of the thread count.
+//===========================================================================
+void SLICFixed::PerformSLICO_ForGivenStepSize(
+	const unsigned char*		lvec,
+	const unsigned char*		avec,
+	const unsigned char*		bvec,
+	const int&					width,
+	const int&					height,
+	int*						klabels,
+	int&						numlabels,
+	const int&					STEP)
+{
+	m_lvec = lvec;
+	m_avec = avec;
+	m_bvec = bvec;
+	m_width = width;
+	m_height = height;
+	const int sz = width*height;
+	numlabels = 0;
+	if( sz == 0 || STEP <= 0 ) return;
+
+	vector<int> kseedsl, kseedsa, kseedsb, kseedsx, kseedsy;
+	GetSeeds(STEP, kseedsl, kseedsa, kseedsb, kseedsx, kseedsy);
+	const int numk = kseedsx.size();
+
+	int offset = STEP;
+	if(STEP < 10) offset = STEP*1.5;
+	unsigned int invxywt = ((1u << Q_SHIFT) + STEP*STEP/2)/unsigned(STEP*STEP);
+	if( invxywt == 0 ) invxywt = 1;
+
+	const int initmaxlab = 100;
+	vector<int> maxlab(numk, initmaxlab);
+	vector<unsigned int> invmaxlab(numk);
+
+	vector<int> distlab(sz, 0);
+	vector<unsigned int> distvec(sz, UINT_MAX);
+	vector<int> sigmal(numk), sigmaa(numk), sigmab(numk), sigmax(numk), sigmay(numk);
+	vector<int> clustersize(numk);
+	{for( int i = 0; i < sz; i++ ) klabels[i] = 0;}
+
+	//-----------------------------------------------------------------
+	// Horizontal tiles, each with the seeds whose window overlaps it
+	//-----------------------------------------------------------------
+	const int numtiles = m_numthreads > 1 ? (height < 4*m_numthreads ? height : 4*m_numthreads) : 1;
+	vector< vector<int> > tileseeds(numtiles);
+
+	for( int itr = 0; itr < 10; itr++ )
+	{
+		distvec.assign(sz, UINT_MAX);
+		{for( int n = 0; n < numk; n++ )
+		{
+			invmaxlab[n] = ((1u << Q_SHIFT) + unsigned(maxlab[n])/2)/unsigned(maxlab[n]);
+			if( invmaxlab[n] == 0 ) invmaxlab[n] = 1;
+		}}
+		{for( int t = 0; t < numtiles; t++ ) tileseeds[t].clear();}
+		{for( int n = 0; n < numk; n++ )
+		{
+			for( int t = 0; t < numtiles; t++ )
+			{
+				const int r1 = t*height/numtiles;
+				const int r2 = (t+1)*height/numtiles;
+				if( kseedsy[n]+offset > r1 && kseedsy[n]-offset < r2 ) tileseeds[t].push_back(n);
+			}
+		}}
+		#pragma omp parallel for num_threads(m_numthreads) schedule(dynamic) if(numtiles > 1)
+		for( int t = 0; t < numtiles; t++ )
+		{
+			AssignRows(t*height/numtiles, (t+1)*height/numtiles, tileseeds[t], kseedsl, kseedsa, kseedsb,
+				kseedsx, kseedsy, invmaxlab, invxywt, offset, klabels, &distlab[0], &distvec[0]);
+		}
+
+		//-----------------------------------------------------------------
+		// Max colour distance per cluster, and the new centroids
+		//-----------------------------------------------------------------
+		sigmal.assign(numk, 0);
+		sigmaa.assign(numk, 0);
+		sigmab.assign(numk, 0);
+		sigmax.assign(numk, 0);
+		sigmay.assign(numk, 0);
+		clustersize.assign(numk, 0);
+		for( int y = 0; y < height; y++ )
+		{
+			for( int x = 0; x < width; x++ )
+			{
+				const int i = y*width + x;
+				const int k = klabels[i];
+				if( maxlab[k] < distlab[i] ) maxlab[k] = distlab[i];
+				sigmal[k] += lvec[i];
+				sigmaa[k] += avec[i];
+				sigmab[k] += bvec[i];
+				sigmax[k] += x - kseedsx[k];
+				sigmay[k] += y - kseedsy[k];
+				clustersize[k]++;
+			}
+		}
+		{for( int k = 0; k < numk; k++ )
+		{
+			const int c = clustersize[k];
+			if( c <= 0 ) continue;	// an empty cluster keeps its seed
+			// rounded divisions; the colour sums are non-negative
+			kseedsl[k] = (sigmal[k] + c/2)/c;
+			kseedsa[k] = (sigmaa[k] + c/2)/c;
+			kseedsb[k] = (sigmab[k] + c/2)/c;
+			kseedsx[k] += (sigmax[k] >= 0 ? sigmax[k] + c/2 : sigmax[k] - c/2)/c;
+			kseedsy[k] += (sigmay[k] >= 0 ? sigmay[k] + c/2 : sigmay[k] - c/2)/c;
+		}}
+	}
+
+	int K = double(sz)/double(STEP*STEP);
+	if( K < 1 ) K = 1;
+	numlabels = numk;
+	SLIC connectivity;
+	connectivity.SetNumThreads(m_numthreads);
+	connectivity.EnforceLabelConnectivity(klabels, width, height, klabels, numlabels, K);
+}
+
+//===========================================================================
+///	PerformSLICO_ForGivenStepSize
+///
+/// The only full-size buffers are the three byte planes.
+//===========================================================================
+void SLICFixed::PerformSLICO_ForGivenStepSize(
+	const unsigned int*			ubuff,
+	const int&					width,
+	const int&					height,
+	int*						klabels,
+	int&						numlabels,
+	const int&					STEP)
+{
+	const int sz = width*height;
+	if( sz <= 0 ) { numlabels = 0; return; }
+	vector<unsigned char> lq(sz), aq(sz), bq(sz);
+	#pragma omp parallel for num_threads(m_numthreads) if(m_numthreads > 1)
+	for( int y = 0; y < height; y++ )
+	{
+		ARGB2Lab(ubuff + y*width, width, &lq[y*width], &aq[y*width], &bq[y*width]);
+	}
+	PerformSLICO_ForGivenStepSize(&lq[0], &aq[0], &bq[0], width, height, klabels, numlabels, STEP);
+}
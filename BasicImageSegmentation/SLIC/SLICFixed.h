@@ -0,0 +1,106 @@
+// SLICFixed.h: integer-only SLIC for machines with a slow FPU.
+//===========================================================================
+// The clustering of SLIC::PerformSLICO_ForGivenStepSize (perturbed grid
+// seeds, SLICO distance with a per-cluster colour normalisation, 10
+// iterations, connectivity clean-up) on 8-bit Lab planes:
+//
+//	L in [0,100], a and b offset by 128, all in Lab units, clamped to [0,255]
+//
+// One unit per channel keeps the colour distance in the proportions of the
+// double-precision SLIC. The conversion from RGB uses integer tables, the
+// squared distances are 32-bit integers, and the two divisions of the SLICO
+// distance become multiplications by Q20 reciprocals, so no floating point
+// is done per pixel. Seed positions and colours are kept rounded to
+// integers. The labels are close to, not identical with, those of the
+// double-precision SLIC.
+//===========================================================================
+
+#if !defined(_SLICFIXED_H_INCLUDED_)
+#define _SLICFIXED_H_INCLUDED_
+
+#include <vector>
+using namespace std;
+
+class SLICFixed
+{
+public:
+	SLICFixed();
+
+	//============================================================================
+	// Threads for the assignment step and the connectivity pass (1 = serial).
+	// The labels do not depend on the thread count.
+	//============================================================================
+	void SetNumThreads(const int& numthreads) { m_numthreads = numthreads < 1 ? 1 : numthreads; }
+
+	//============================================================================
+	// 8-bit Lab planes of width*height pixels. klabels receives the labels in
+	// raster order.
+	//============================================================================
+	void PerformSLICO_ForGivenStepSize(
+		const unsigned char*		lvec,
+		const unsigned char*		avec,
+		const unsigned char*		bvec,
+		const int&					width,
+		const int&					height,
+		int*						klabels,
+		int&						numlabels,
+		const int&					STEP);
+	//============================================================================
+	// Same on a 0x00RRGGBB buffer, converted with ARGB2Lab first
+	//============================================================================
+	void PerformSLICO_ForGivenStepSize(
+		const unsigned int*			ubuff,
+		const int&					width,
+		const int&					height,
+		int*						klabels,
+		int&						numlabels,
+		const int&					STEP);
+
+	//============================================================================
+	// 0x00RRGGBB pixels to the 8-bit layout above, in integer arithmetic. The
+	// values are within one unit of the rounded ColorConverter::ARGB2Lab.
+	//============================================================================
+	static void ARGB2Lab(
+		const unsigned int*			ubuff,
+		const int&					n,
+		unsigned char*				lq,
+		unsigned char*				aq,
+		unsigned char*				bq);
+
+private:
+	// gradient used for seed perturbation; 0 on the border, as in DetectLabEdges
+	int Edge(const int& x, const int& y) const;
+
+	void GetSeeds(
+		const int&					STEP,
+		vector<int>&				kseedsl,
+		vector<int>&				kseedsa,
+		vector<int>&				kseedsb,
+		vector<int>&				kseedsx,
+		vector<int>&				kseedsy);
+
+	void AssignRows(
+		const int&					r1,
+		const int&					r2,
+		const vector<int>&			seeds,
+		const vector<int>&			kseedsl,
+		const vector<int>&			kseedsa,
+		const vector<int>&			kseedsb,
+		const vector<int>&			kseedsx,
+		const vector<int>&			kseedsy,
+		const vector<unsigned int>&	invmaxlab,
+		const unsigned int&			invxywt,
+		const int&					offset,
+		int*						klabels,
+		int*						distlab,
+		unsigned int*				distvec);
+
+	int										m_numthreads;
+	const unsigned char*					m_lvec;
+	const unsigned char*					m_avec;
+	const unsigned char*					m_bvec;
+	int										m_width;
+	int										m_height;
+};
+
+#endif // !defined(_SLICFIXED_H_INCLUDED_)
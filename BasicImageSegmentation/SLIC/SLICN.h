@@ -0,0 +1,340 @@
+// SLICN.h: SLIC superpixels on N-channel images of any pixel type.
+//===========================================================================
+// The clustering of SLIC::PerformSLICO_ForGivenStepSize (grid seeds moved
+// to the lowest gradient in their 3x3 neighbourhood, SLICO distance with a
+// per-cluster colour normalisation, 10 iterations, connectivity clean-up),
+// run on the raw channel values of an interleaved, row-strided image rather
+// than on CIELAB. Meant for 16-bit medical images and multispectral stacks,
+// which cannot go through the ARGB buffer of SLIC.
+//
+// T is the channel type (unsigned char, unsigned short, float, ...). CN is
+// the number of channels, or 0 to give it at run time; with a fixed CN the
+// per-channel loops have a constant trip count and are unrolled.
+//===========================================================================
+
+#if !defined(_SLICN_H_INCLUDED_)
+#define _SLICN_H_INCLUDED_
+
+#include <vector>
+#include <cfloat>
+#include "SLIC.h"
+using namespace std;
+
+template<typename T, int CN>
+class SLICN
+{
+public:
+	SLICN() : m_numthreads(1) {}
+
+	//============================================================================
+	// Threads for the assignment step and the connectivity pass (1 = serial).
+	// The labels do not depend on the thread count.
+	//============================================================================
+	void SetNumThreads(const int& numthreads) { m_numthreads = numthreads < 1 ? 1 : numthreads; }
+
+	//============================================================================
+	// data points at the first channel of pixel (0,0); rowstep is the distance
+	// between rows in bytes, as in Mat::step. klabels receives width*height
+	// labels in raster order.
+	//============================================================================
+	void PerformSLICO_ForGivenStepSize(
+		const T*					data,
+		const size_t&				rowstep,
+		const int&					width,
+		const int&					height,
+		const int&					channels,
+		int*						klabels,
+		int&						numlabels,
+		const int&					STEP);
+
+private:
+	const T* Pixel(const int& x, const int& y) const
+	{
+		return (const T*)((const unsigned char*)m_data + y*m_rowstep) + x*m_cn;
+	}
+	// squared difference between two pixels, summed over the channels
+	double PixelDist2(const T* p, const T* q) const
+	{
+		double d(0);
+		for( int c = 0; c < (CN > 0 ? CN : m_cn); c++ ) d += (double(p[c]) - double(q[c]))*(double(p[c]) - double(q[c]));
+		return d;
+	}
+	// gradient used for seed perturbation; 0 on the border, as in DetectLabEdges
+	double Edge(const int& x, const int& y) const
+	{
+		if( x < 1 || y < 1 || x >= m_width-1 || y >= m_height-1 ) return 0;
+		return PixelDist2(Pixel(x-1, y), Pixel(x+1, y)) + PixelDist2(Pixel(x, y-1), Pixel(x, y+1));
+	}
+
+	void GetSeeds(
+		const int&					STEP,
+		vector<double>&				kseedsc,
+		vector<double>&				kseedsx,
+		vector<double>&				kseedsy);
+
+	void AssignRows(
+		const int&					r1,
+		const int&					r2,
+		const vector<int>&			seeds,
+		const vector<double>&		kseedsc,
+		const vector<double>&		kseedsx,
+		const vector<double>&		kseedsy,
+		const vector<double>&		maxlab,
+		const double&				invxywt,
+		const int&					offset,
+		int*						klabels,
+		float*						distlab,
+		float*						distvec);
+
+	int										m_numthreads;
+	const T*								m_data;
+	size_t									m_rowstep;
+	int										m_width;
+	int										m_height;
+	int										m_cn;
+};
+
+//===========================================================================
+///	GetSeeds
+///
+/// Same grid as SLIC::GetLABXYSeeds_ForGivenStepSize, with each seed moved
+/// to the lowest gradient of its 3x3 neighbourhood. Only the gradients
+/// around the seeds are computed.
+//===========================================================================
+template<typename T, int CN>
+void SLICN<T, CN>::GetSeeds(
+	const int&					STEP,
+	vector<double>&				kseedsc,
+	vector<double>&				kseedsx,
+	vector<double>&				kseedsy)
+{
+	const int dx8[8] = {-1, -1,  0,  1, 1, 1, 0, -1};
+	const int dy8[8] = { 0, -1, -1, -1, 0, 1, 1,  1};
+
+	int xstrips = (0.5+double(m_width)/double(STEP));
+	int ystrips = (0.5+double(m_height)/double(STEP));
+	if( xstrips < 1 ) xstrips = 1;
+	if( ystrips < 1 ) ystrips = 1;
+	const double xerrperstrip = double(m_width - STEP*xstrips)/double(xstrips);
+	const double yerrperstrip = double(m_height - STEP*ystrips)/double(ystrips);
+	const int xoff = STEP/2;
+	const int yoff = STEP/2;
+
+	const int numseeds = xstrips*ystrips;
+	kseedsc.resize(numseeds*m_cn);
+	kseedsx.resize(numseeds);
+	kseedsy.resize(numseeds);
+
+	int n(0);
+	for( int y = 0; y < ystrips; y++ )
+	{
+		int ye = y*yerrperstrip;
+		for( int x = 0; x < xstrips; x++, n++ )
+		{
+			int xe = x*xerrperstrip;
+			int sx = x*STEP+xoff+xe;
+			int sy = y*STEP+yoff+ye;
+			if( sx >= m_width ) sx = m_width-1;
+			if( sy >= m_height ) sy = m_height-1;
+
+			double best = Edge(sx, sy);
+			int bx(sx), by(sy);
+			for( int i = 0; i < 8; i++ )
+			{
+				int nx = sx+dx8[i];
+				int ny = sy+dy8[i];
+				if( nx >= 0 && nx < m_width && ny >= 0 && ny < m_height )
+				{
+					double e = Edge(nx, ny);
+					if( e < best ) { best = e; bx = nx; by = ny; }
+				}
+			}
+			const T* p = Pixel(bx, by);
+			for( int c = 0; c < m_cn; c++ ) kseedsc[n*m_cn + c] = p[c];
+			kseedsx[n] = bx;
+			kseedsy[n] = by;
+		}
+	}
+}
+
+//===========================================================================
+///	AssignRows
+///
+/// Assignment step restricted to rows [r1, r2), for the given seeds in
+/// ascending order. distlab keeps the colour distance to the winning seed.
+//===========================================================================
+template<typename T, int CN>
+void SLICN<T, CN>::AssignRows(
+	const int&					r1,
+	const int&					r2,
+	const vector<int>&			seeds,
+	const vector<double>&		kseedsc,
+	const vector<double>&		kseedsx,
+	const vector<double>&		kseedsy,
+	const vector<double>&		maxlab,
+	const double&				invxywt,
+	const int&					offset,
+	int*						klabels,
+	float*						distlab,
+	float*						distvec)
+{
+	for( int s = 0; s < int(seeds.size()); s++ )
+	{
+		const int n = seeds[s];
+		int y1 = int(kseedsy[n])-offset;
+		int y2 = int(kseedsy[n])+offset;
+		int x1 = int(kseedsx[n])-offset;
+		int x2 = int(kseedsx[n])+offset;
+		if( y1 < r1 ) y1 = r1;
+		if( y2 > r2 ) y2 = r2;
+		if( x1 < 0 ) x1 = 0;
+		if( x2 > m_width ) x2 = m_width;
+
+		const double* sc = &kseedsc[n*m_cn];
+		const double invmaxlab = 1.0/maxlab[n];
+		for( int y = y1; y < y2; y++ )
+		{
+			const T* p = Pixel(x1, y);
+			const double dy = y - kseedsy[n];
+			const int row = y*m_width;
+			for( int x = x1; x < x2; x++, p += m_cn )
+			{
+				double dlab(0);
+				for( int c = 0; c < (CN > 0 ? CN : m_cn); c++ ) dlab += (double(p[c]) - sc[c])*(double(p[c]) - sc[c]);
+				const double dx = x - kseedsx[n];
+				const float dist = float(dlab*invmaxlab + (dx*dx + dy*dy)*invxywt);
+				if( dist < distvec[row+x] )
+				{
+					distvec[row+x] = dist;
+					distlab[row+x] = float(dlab);
+					klabels[row+x] = n;
+				}
+			}
+		}
+	}
+}
+
+//===========================================================================
+///	PerformSLICO_ForGivenStepSize
+///
+/// The first iteration normalises colour distances by a tenth of the value
+/// range, squared, which is what the fixed 10*10 start of SLIC amounts to
+/// for the L channel. The centroids are accumulated serially in raster
+/// order, so the result does not depend on the thread count.
+//===========================================================================
+template<typename T, int CN>
+void SLICN<T, CN>::PerformSLICO_ForGivenStepSize(
+	const T*					data,
+	const size_t&				rowstep,
+	const int&					width,
+	const int&					height,
+	const int&					channels,
+	int*						klabels,
+	int&						numlabels,
+	const int&					STEP)
+{
+	m_data = data;
+	m_rowstep = rowstep;
+	m_width = width;
+	m_height = height;
+	m_cn = CN > 0 ? CN : channels;
+	const int cn = m_cn;
+	const int sz = width*height;
+	numlabels = 0;
+	if( sz == 0 || STEP <= 0 ) return;
+
+	vector<double> kseedsc, kseedsx, kseedsy;
+	GetSeeds(STEP, kseedsc, kseedsx, kseedsy);
+	const int numk = kseedsx.size();
+
+	int offset = STEP;
+	if(STEP < 10) offset = STEP*1.5;
+	const double invxywt = 1.0/(STEP*STEP);
+
+	double lo(DBL_MAX), hi(-DBL_MAX);
+	{for( int y = 0; y < height; y++ )
+	{
+		const T* p = Pixel(0, y);
+		for( int i = 0; i < width*cn; i++ )
+		{
+			if( p[i] < lo ) lo = p[i];
+			if( p[i] > hi ) hi = p[i];
+		}
+	}}
+	double initmaxlab = (hi - lo)*(hi - lo)/100.0;
+	if( initmaxlab <= 0 ) initmaxlab = 1;
+	vector<double> maxlab(numk, initmaxlab);
+
+	vector<float> distlab(sz, 0);
+	vector<float> distvec(sz, FLT_MAX);
+	vector<double> sigmac(numk*cn), sigmax(numk), sigmay(numk);
+	vector<int> clustersize(numk);
+	{for( int i = 0; i < sz; i++ ) klabels[i] = 0;}
+
+	//-----------------------------------------------------------------
+	// Horizontal tiles, each with the seeds whose window overlaps it
+	//-----------------------------------------------------------------
+	const int numtiles = m_numthreads > 1 ? (height < 4*m_numthreads ? height : 4*m_numthreads) : 1;
+	vector< vector<int> > tileseeds(numtiles);
+
+	for( int itr = 0; itr < 10; itr++ )
+	{
+		distvec.assign(sz, FLT_MAX);
+		{for( int t = 0; t < numtiles; t++ ) tileseeds[t].clear();}
+		{for( int n = 0; n < numk; n++ )
+		{
+			for( int t = 0; t < numtiles; t++ )
+			{
+				const int r1 = t*height/numtiles;
+				const int r2 = (t+1)*height/numtiles;
+				if( int(kseedsy[n])+offset > r1 && int(kseedsy[n])-offset < r2 ) tileseeds[t].push_back(n);
+			}
+		}}
+		#pragma omp parallel for num_threads(m_numthreads) schedule(dynamic) if(numtiles > 1)
+		for( int t = 0; t < numtiles; t++ )
+		{
+			AssignRows(t*height/numtiles, (t+1)*height/numtiles, tileseeds[t], kseedsc, kseedsx, kseedsy,
+				maxlab, invxywt, offset, klabels, &distlab[0], &distvec[0]);
+		}
+
+		//-----------------------------------------------------------------
+		// Max colour distance per cluster, and the new centroids
+		//-----------------------------------------------------------------
+		sigmac.assign(numk*cn, 0);
+		sigmax.assign(numk, 0);
+		sigmay.assign(numk, 0);
+		clustersize.assign(numk, 0);
+		for( int y = 0; y < height; y++ )
+		{
+			const T* p = Pixel(0, y);
+			for( int x = 0; x < width; x++, p += cn )
+			{
+				const int i = y*width + x;
+				const int k = klabels[i];
+				if( maxlab[k] < distlab[i] ) maxlab[k] = distlab[i];
+				double* sc = &sigmac[k*cn];
+				for( int c = 0; c < (CN > 0 ? CN : cn); c++ ) sc[c] += p[c];
+				sigmax[k] += x;
+				sigmay[k] += y;
+				clustersize[k]++;
+			}
+		}
+		{for( int k = 0; k < numk; k++ )
+		{
+			if( clustersize[k] <= 0 ) continue;	// an empty cluster keeps its seed
+			const double inv = 1.0/double(clustersize[k]);
+			for( int c = 0; c < cn; c++ ) kseedsc[k*cn + c] = sigmac[k*cn + c]*inv;
+			kseedsx[k] = sigmax[k]*inv;
+			kseedsy[k] = sigmay[k]*inv;
+		}}
+	}
+
+	int K = double(sz)/double(STEP*STEP);
+	if( K < 1 ) K = 1;
+	numlabels = numk;
+	SLIC connectivity;
+	connectivity.SetNumThreads(m_numthreads);
+	connectivity.EnforceLabelConnectivity(klabels, width, height, klabels, numlabels, K);
+}
+
+#endif // !defined(_SLICN_H_INCLUDED_)
@@ -0,0 +1,125 @@
+// SLICNCheck.cpp : checks that images other than 8-bit BGR reach SLICN at
+// full precision, and that the 8-bit segmentors reject them cleanly.
+//
+// Not part of the Visual Studio project (it has its own main). Build it next
+// to the sources, e.g. with g++ and OpenCV 2.4:
+//   g++ -O2 -fopenmp SLICNCheck.cpp SLICSegmentor.cpp SEEDSSegmentor.cpp segmentor.cpp
+//       FeatureCache.cpp ColorConverter.cpp LabelMapIO.cpp SLIC/SLIC.cpp SLIC/SLICFixed.cpp
+//       SEEDS/seeds2.cpp `pkg-config --cflags --libs opencv`
+// Returns 0 when every check passes.
+//
+
+#include <iostream>
+using namespace std;
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+using namespace cv;
+
+#include "segmentor.h"
+#include "SLICSegmentor.h"
+#include "SEEDSSegmentor.h"
+
+IMPLEMENT_DYNCRT_BASE(Segmentor);
+
+// number of superpixels with pixels on both sides of column _split
+static int Straddling(const Mat& _labels, int _split)
+{
+	Mat labels;
+	if (_labels.type() == CV_16UC1)
+	{
+		labels.create(_labels.size(), CV_32SC1);
+		for (int i = 0; i < _labels.rows; i++)
+			for (int j = 0; j < _labels.cols; j++)
+				labels.at<int>(i, j) = _labels.at<ushort>(i, j);
+	}
+	else
+		labels = _labels;
+
+	int n = 0;
+	for (int i = 0; i < labels.rows; i++)
+		for (int j = 0; j < labels.cols; j++)
+			if (labels.at<int>(i, j) >= n)
+				n = labels.at<int>(i, j) + 1;
+	vector<int> side(n, 0);	// bit 0: left of _split, bit 1: right of it
+	for (int i = 0; i < labels.rows; i++)
+		for (int j = 0; j < labels.cols; j++)
+			side[labels.at<int>(i, j)] |= j < _split ? 1 : 2;
+
+	int straddling = 0;
+	for (int k = 0; k < n; k++)
+		if (side[k] == 3)
+			straddling++;
+	return straddling;
+}
+
+static bool RunSLIC(const Mat& _img, int _split, const string& _what)
+{
+	SLICSegmentor slic;
+	vector<float> args(1, 10);	// Step
+	slic.SetArgs(args);
+	slic.SetImage(_img);
+	slic.Run();
+	int straddling = Straddling(slic.m_Result, _split);
+	cout<<"--"<<_what<<": "<<straddling<<" superpixel(s) across the edge"<<endl;
+	return straddling == 0;
+}
+
+int main(int argc, char* argv[])
+{
+	const int w = 240, h = 160, split = 125;
+	int failed = 0;
+
+	// 16-bit grey, two halves 100 apart: the same 8-bit value after a plain
+	// imread, but separate superpixels when decoded by Segmentor::ReadImage
+	Mat img16(h, w, CV_16UC1);
+	for (int i = 0; i < h; i++)
+		for (int j = 0; j < w; j++)
+			img16.at<ushort>(i, j) = (ushort)((j < split ? 40000 : 40100) + (i*7 + j*3)%5);
+	string name = argc > 1 ? string(argv[1]) : string("slicn_check_16u.png");
+	if (!imwrite(name, img16))
+	{
+		cout<<"--Error: Cannot write "<<name<<endl;
+		return 1;
+	}
+	Mat bgr, raw;
+	Segmentor::ReadImage(name, bgr, raw);
+	if (raw.type() != CV_16UC1)
+	{
+		cout<<"--Error: "<<name<<" was not decoded as CV_16UC1"<<endl;
+		failed++;
+	}
+	else if (!RunSLIC(raw, split, "16-bit grey"))
+		failed++;
+
+	// the 8-bit segmentors must refuse it with an exception, not an assertion
+	try
+	{
+		SEEDSSegmentor seeds;
+		seeds.SetImage(raw);
+		cout<<"--Error: SEEDS accepted a CV_16UC1 image"<<endl;
+		failed++;
+	}
+	catch (const std::exception& e)
+	{
+		cout<<"--SEEDS rejects CV_16UC1: "<<e.what()<<endl;
+	}
+
+	// 5-channel float: the halves differ in the last channel only
+	Mat img5(h, w, CV_32FC(5));
+	for (int i = 0; i < h; i++)
+	{
+		float* ptr = img5.ptr<float>(i);
+		for (int j = 0; j < w; j++, ptr += 5)
+		{
+			ptr[0] = ptr[1] = ptr[2] = 0.5f;
+			ptr[3] = 0.01f*((i + j)%3);
+			ptr[4] = j < split ? 0.2f : 0.8f;
+		}
+	}
+	if (!RunSLIC(img5, split, "5-channel float"))
+		failed++;
+
+	cout<<(failed ? "FAILED" : "passed")<<endl;
+	return failed ? 1 : 0;
+}
@@ -1,4 +1,6 @@
 #include "SLICSegmentor.h"
+#include "SLIC/SLICN.h"
+#include "SLIC/SLICFixed.h"
 
 //IMPLEMENT_DYNCRT_CLASS(SLICSegmentor);
 
@@ -7,20 +9,29 @@ SLICSegmentor::SLICSegmentor(void)
 	m_Name = "SLIC";
 
 	m_Step = 7; 
-
-	m_argNum = 1;
+	m_NumThreads = 1;
+	m_FloatKernel = 0;
+	m_MaxShift = 0;
+	m_MaxChanged = 0;
+	m_Preemptive = 0;
+	m_FixedPoint = 0;
+	m_Stream = 0;
+	m_StreamSlic = NULL;
+
+	m_argNum = 8;
 }
 
 SLICSegmentor::~SLICSegmentor(void)
 {
+	delete m_StreamSlic;
 }
 
 void SLICSegmentor::SetArgs(const vector<float> _args)
 {
 	cout<<"["<<m_Name<<"] Getting arguments..."<<endl;
 
-	float argu[] = {m_Step};
-	string argNames[] = {"Step"};
+	float argu[] = {m_Step, m_NumThreads, m_FloatKernel, m_MaxShift, m_MaxChanged, m_Preemptive, m_FixedPoint, m_Stream};
+	string argNames[] = {"Step", "NumThreads", "FloatKernel", "MaxShift", "MaxChanged", "Preemptive", "FixedPoint", "Stream"};
 	cout<<"--Given "<<(_args.size()>m_argNum ? m_argNum : _args.size())<<" argument(s)"; 
 	int i = 0;
 	for ( ; i < _args.size(); i++)
@@ -34,33 +45,106 @@ void SLICSegmentor::SetArgs(const vector<float> _args)
 	}
 	cout<<endl;
 
-	m_Step = argu[0];
+	m_Step = argu[0]; m_NumThreads = argu[1]; m_FloatKernel = argu[2];
+	m_MaxShift = argu[3]; m_MaxChanged = argu[4]; m_Preemptive = argu[5];
+	m_FixedPoint = argu[6]; m_Stream = argu[7];
+	if (m_StreamSlic)
+		m_StreamSlic->ResetStream();	// new arguments start a new sequence
+	m_PostThreads = m_NumThreads;
+	if (m_FloatKernel && m_Preemptive)
+	{
+		// the float kernel has no active-cluster mode
+		cout<<"--Preemptive is not supported by FloatKernel, ignoring it"<<endl;
+		m_Preemptive = 0;
+	}
 
 	stringstream ss;
-	ss<<m_Name<<"_"<<m_Step<<".txt";
+	ss<<m_Name<<"_"<<m_Step;
+	if (m_FloatKernel) ss<<"_f";
+	if (m_MaxShift > 0 || m_MaxChanged > 0) ss<<"_c";
+	if (m_Preemptive) ss<<"_p";
+	if (m_FixedPoint) ss<<"_i";
+	if (m_Stream > 0) ss<<"_s";
+	ss<<".txt";
 	m_ResultName = ss.str();
 }
 
+// SLIC on the raw channels of an image that is not 8-bit BGR, with the
+// common channel counts unrolled
+template<typename T>
+static void RunSLICN(const Mat& _img, int* _klabels, int& _numLabels, int _step, int _numThreads)
+{
+	const T* data = _img.ptr<T>(0);
+	int w = _img.cols, h = _img.rows, cn = _img.channels();
+	switch (cn)
+	{
+	case 1: { SLICN<T, 1> s; s.SetNumThreads(_numThreads); s.PerformSLICO_ForGivenStepSize(data, _img.step, w, h, cn, _klabels, _numLabels, _step); break; }
+	case 3: { SLICN<T, 3> s; s.SetNumThreads(_numThreads); s.PerformSLICO_ForGivenStepSize(data, _img.step, w, h, cn, _klabels, _numLabels, _step); break; }
+	case 4: { SLICN<T, 4> s; s.SetNumThreads(_numThreads); s.PerformSLICO_ForGivenStepSize(data, _img.step, w, h, cn, _klabels, _numLabels, _step); break; }
+	default: { SLICN<T, 0> s; s.SetNumThreads(_numThreads); s.PerformSLICO_ForGivenStepSize(data, _img.step, w, h, cn, _klabels, _numLabels, _step); break; }
+	}
+}
+
 void SLICSegmentor::Run()
 {
 	cout<<"====="<<m_Name<<" Runing..."<<endl;
 
-	SLIC slicsp;
 	int h = m_Img.rows, w = m_Img.cols;
-	uint* imgData = new uint[h*w];
-
-	for (int i = 0; i < h; i++)
+	int numLabels;
+	if (m_Img.type() != CV_8UC3)
 	{
-		for (int j = 0; j < w; j++)
+		// 16-bit, float or multispectral input: cluster the raw channel values
+		if (m_FloatKernel || m_MaxShift > 0 || m_MaxChanged > 0 || m_Preemptive || m_FixedPoint || m_Stream > 0)
+			cout<<"--FloatKernel, MaxShift, MaxChanged, Preemptive, FixedPoint and Stream "
+				"only apply to 8-bit images, ignoring them"<<endl;
+		int* labels = m_Result.ptr<int>(0);	// created continuous by SetImage
+		switch (m_Img.depth())
 		{
-			cv::Vec3b bgr = m_Img.at<cv::Vec3b>(i, j);
-			imgData[i*w+j] = (bgr[2]<<16) | (bgr[1]<<8) | (bgr[0]);
+		case CV_8U: RunSLICN<uchar>(m_Img, labels, numLabels, m_Step, m_NumThreads); break;
+		case CV_16U: RunSLICN<ushort>(m_Img, labels, numLabels, m_Step, m_NumThreads); break;
+		case CV_16S: RunSLICN<short>(m_Img, labels, numLabels, m_Step, m_NumThreads); break;
+		case CV_32F: RunSLICN<float>(m_Img, labels, numLabels, m_Step, m_NumThreads); break;
+		default: CV_Error(CV_StsUnsupportedFormat, "SLIC: unsupported pixel depth");
 		}
-	}	
+		Segmentor::Run();
+		return;
+	}
+
+	if (m_FixedPoint)
+	{
+		// integer conversion and clustering on 8-bit Lab, so the double Lab
+		// planes are not needed; the other SLIC options do not apply
+		SLICFixed slicfx;
+		slicfx.SetNumThreads(m_NumThreads);
+		slicfx.PerformSLICO_ForGivenStepSize(m_Cache->ARGB(), w, h, m_Result.ptr<int>(0), numLabels, m_Step);
+		Segmentor::Run();
+		return;
+	}
+
+	const double *lvec, *avec, *bvec;
+	m_Cache->LabPlanes(lvec, avec, bvec);
+
+	SLIC slicsp;
+	if (m_Stream > 0 && m_StreamSlic == NULL)
+		m_StreamSlic = new SLIC;
+	SLIC& slic = m_Stream > 0 ? *m_StreamSlic : slicsp;
 
-	int numLabels;
 	int *klabels = new int[h*w];
-	slicsp.PerformSLICO_ForGivenStepSize(imgData, w, h, klabels, numLabels, m_Step, NULL);
+	slic.SetNumThreads(m_NumThreads);
+	slic.SetFloatKernel(m_FloatKernel != 0);
+	slic.SetConvergence(m_MaxShift, m_MaxChanged);
+	slic.SetPreemptive(m_Preemptive != 0);
+	// no edge map: seed perturbation only needs gradients around the seeds
+	slic.SetLABPlanes(lvec, avec, bvec);
+	// the Lab planes come from the cache, so the ARGB buffer is not needed
+	if (m_Stream > 0)
+	{
+		// starts afresh by itself on the first frame and when the size changes
+		slic.PerformSLICO_ForNextFrame(NULL, w, h, klabels, numLabels, m_Step, m_Stream);
+	}
+	else
+		slic.PerformSLICO_ForGivenStepSize(NULL, w, h, klabels, numLabels, m_Step, NULL);
+	cout<<"--"<<slic.GetNumIterations()<<" iteration(s)"<<endl;
 
 	for (int i = 0; i < h; i++)
 	{
@@ -72,8 +156,10 @@ void SLICSegmentor::Run()
 	}
 
 	delete[] klabels;
-	delete[] imgData;
 
-	Segmentor::Run();
+	// streamed labels are seed indices, which name the same superpixel in
+	// every frame, so they are not renumbered
+	if (m_Stream <= 0)
+		Segmentor::Run();
 }
 
@@ -18,6 +18,23 @@ public:
 
 	virtual void Run();
 
+	// 16-bit, float and multispectral images are clustered on their raw channels
+	virtual bool AcceptsAnyImage() const { return true; }
+	virtual bool IsStreaming() const { return m_Stream > 0; }
+
 private:
 	int m_Step;
+	int m_NumThreads;
+	int m_FloatKernel;
+	float m_MaxShift;	// convergence tolerances, see SLIC::SetConvergence; 0 = off
+	float m_MaxChanged;
+	int m_Preemptive;	// active-cluster iterations, see SLIC::SetPreemptive
+	int m_FixedPoint;	// integer SLIC on 8-bit Lab, see SLICFixed
+	int m_Stream;		// > 0: the images are consecutive video frames (batch
+						// mode then runs one decoder and one worker), and each
+						// frame after the first gets m_Stream iterations, see
+						// SLIC::PerformSLICO_ForNextFrame
+
+	// keeps the seeds of the previous frame while streaming
+	SLIC* m_StreamSlic;
 };
@@ -0,0 +1,125 @@
+#include "TiledSLIC.h"
+
+#include <ctype.h>
+#include <iostream>
+
+static bool Seek64(FILE* _file, long long _offset)
+{
+#ifdef _WIN32
+	return _fseeki64(_file, _offset, SEEK_SET) == 0;
+#else
+	return fseeko(_file, (off_t)_offset, SEEK_SET) == 0;
+#endif
+}
+
+// next decimal number of a PPM header, skipping whitespace and comments
+static bool ReadHeaderInt(FILE* _file, int& _value)
+{
+	int c = fgetc(_file);
+	while (c != EOF && (isspace(c) || c == '#'))
+	{
+		if (c == '#')
+		{
+			while (c != EOF && c != '\n')
+				c = fgetc(_file);
+		}
+		c = fgetc(_file);
+	}
+	if (c == EOF || !isdigit(c))
+		return false;
+	_value = 0;
+	while (c != EOF && isdigit(c))
+	{
+		_value = _value*10 + (c - '0');
+		c = fgetc(_file);
+	}
+	// a single whitespace character ends the header field
+	return c != EOF && isspace(c);
+}
+
+PPMRowSource::PPMRowSource(void)
+{
+	m_File = NULL;
+	m_Width = m_Height = 0;
+	m_DataOffset = 0;
+}
+
+PPMRowSource::~PPMRowSource(void)
+{
+	if (m_File)
+		fclose(m_File);
+}
+
+bool PPMRowSource::Open(const string& _fileName)
+{
+	if (m_File)
+		fclose(m_File);
+	m_File = fopen(_fileName.c_str(), "rb");
+	if (m_File == NULL)
+	{
+		cout<<"--Error: Cannot open image: "<<_fileName<<endl;
+		return false;
+	}
+
+	int maxVal = 0;
+	bool ok = fgetc(m_File) == 'P' && fgetc(m_File) == '6'
+		&& ReadHeaderInt(m_File, m_Width) && ReadHeaderInt(m_File, m_Height)
+		&& ReadHeaderInt(m_File, maxVal) && maxVal == 255 && m_Width > 0 && m_Height > 0;
+	if (!ok)
+	{
+		cout<<"--Error: Not an 8-bit binary PPM (P6) image: "<<_fileName<<endl;
+		fclose(m_File);
+		m_File = NULL;
+		return false;
+	}
+#ifdef _WIN32
+	m_DataOffset = _ftelli64(m_File);
+#else
+	m_DataOffset = ftello(m_File);
+#endif
+	return true;
+}
+
+bool PPMRowSource::ReadRows(const int& _y, const int& _rows, unsigned int* _argb)
+{
+	if (m_File == NULL || _y < 0 || _rows < 0 || _y + _rows > m_Height)
+		return false;
+	size_t count = (size_t)_rows*m_Width*3;
+	m_Buffer.resize(count);
+	if (!Seek64(m_File, m_DataOffset + (long long)_y*m_Width*3)
+		|| fread(&m_Buffer[0], 1, count, m_File) != count)
+		return false;
+
+	const unsigned char* rgb = &m_Buffer[0];
+	for (size_t i = 0; i < count/3; i++, rgb += 3)
+		_argb[i] = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+	return true;
+}
+
+int TiledSLIC::Run(const string& _imageFile, const string& _labelFile,
+	int _step, int _stripRows, int _numThreads)
+{
+	PPMRowSource source;
+	if (!source.Open(_imageFile))
+		return -1;
+
+	LabelMapStreamWriter writer;
+	if (!writer.Open(_labelFile, source.Width(), source.Height()))
+	{
+		cout<<"--Error: Cannot write labels: "<<_labelFile<<endl;
+		return -1;
+	}
+	LabelMapRowSink sink(writer);
+
+	SLIC slic;
+	slic.SetNumThreads(_numThreads);
+	int numLabels = 0;
+	bool ok = slic.PerformSLICO_ForStrips(source, sink, numLabels, _step, _stripRows);
+	ok = writer.Close(numLabels) && ok;
+	if (!ok)
+	{
+		cout<<"--Error: Tiled SLIC failed on "<<_imageFile<<endl;
+		return -1;
+	}
+	return numLabels;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "SLIC/SLIC.h"
+#include "LabelMapIO.h"
+
+// Reads rows of a binary PPM file (P6, maxval 255) on demand, so the image
+// never has to be decoded as a whole.
+class PPMRowSource : public SLICRowSource
+{
+public:
+	PPMRowSource(void);
+	~PPMRowSource(void);
+
+	bool Open(const string& _fileName);
+
+	virtual int Width() const { return m_Width; }
+	virtual int Height() const { return m_Height; }
+	virtual bool ReadRows(const int& _y, const int& _rows, unsigned int* _argb);
+
+private:
+	PPMRowSource(const PPMRowSource&);
+	PPMRowSource& operator=(const PPMRowSource&);
+
+	FILE* m_File;
+	int m_Width, m_Height;
+	long long m_DataOffset;
+	vector<unsigned char> m_Buffer;
+};
+
+// Appends the rows of every strip to a label-map file
+class LabelMapRowSink : public SLICLabelSink
+{
+public:
+	LabelMapRowSink(LabelMapStreamWriter& _writer) : m_Writer(_writer) {}
+	virtual bool WriteRows(const int& _y, const int& _rows, const int* _labels)
+	{
+		return m_Writer.WriteRows(_labels, _rows);
+	}
+
+private:
+	LabelMapRowSink& operator=(const LabelMapRowSink&);
+
+	LabelMapStreamWriter& m_Writer;
+};
+
+// Out-of-core SLIC (SLIC::PerformSLICO_ForStrips) from a PPM file to a raw
+// ".lbl" file, for images too large for SLICSegmentor (gigapixel slides,
+// mosaics). Memory is proportional to width*(_stripRows + halo), whatever
+// the image height.
+class TiledSLIC
+{
+public:
+	// Returns the number of superpixel labels, or -1 on failure.
+	static int Run(const string& _imageFile, const string& _labelFile,
+		int _step, int _stripRows, int _numThreads);
+};
@@ -1,4 +1,12 @@
 #include "segmentor.h"
+#include "LabelMapIO.h"
+
+#include <limits.h>
+#include <algorithm>
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SEGMENTOR_SSE2
+#endif
 
 //IMPLEMENT_DYNCRT_BASE(Segmentor);
 
@@ -11,41 +19,278 @@
 
 Segmentor::Segmentor()
 {
-	
+	m_Cache = NULL;
+	m_OwnCache = false;
+	m_TextOutput = false;
+	m_PostThreads = 1;
 }
 
 Segmentor::~Segmentor(void)
 {
+	if (m_OwnCache)
+		delete m_Cache;
 }
 
-void Segmentor::SetImage(const Mat& _img)
+void Segmentor::SetImage(const Mat& _img, FeatureCache* _cache)
 {
-	m_Img = _img.clone(); 
+	if (!AcceptsAnyImage() && _img.type() != CV_8UC3)
+		CV_Error(CV_StsUnsupportedFormat, m_Name + " needs an 8-bit, 3-channel image");
+
+	m_Img = _img;
 	m_Result.create(m_Img.size(), CV_32SC1);
+
+	if (m_OwnCache)
+		delete m_Cache;
+	m_OwnCache = (_cache == NULL || !_cache->Matches(_img));
+	m_Cache = m_OwnCache ? new FeatureCache(m_Img) : _cache;
 }
 
-void Segmentor::ShowResult(const Vec3b& _color)
+void Segmentor::ReadImage(const string& _fileName, Mat& _bgr, Mat& _raw, bool _wantBGR, bool _wantRaw)
+{
+	_bgr.release();
+	_raw.release();
+	if (_wantRaw)
+	{
+		Mat img = imread(_fileName, IMREAD_ANYDEPTH|IMREAD_ANYCOLOR);
+		if (img.empty())
+			return;
+		int cn = img.channels();
+		if (img.depth() == CV_8U && (cn == 1 || cn == 3 || cn == 4))
+		{
+			// an ordinary 8-bit image: everybody clusters it in Lab
+			if (cn == 3)
+				_raw = img;
+			else
+				cvtColor(img, _raw, cn == 1 ? CV_GRAY2BGR : CV_BGRA2BGR);
+			_bgr = _raw;
+			return;
+		}
+		_raw = img;
+	}
+	if (_wantBGR)
+		_bgr = imread(_fileName);
+}
+
+// Writes the relabelled rows [r1, r2) of _labels to _dst (CV_16UC1, or
+// CV_32SC1 which may be _labels itself). Labels missing from the table get
+// the next free number in raster order.
+template<typename T>
+static void RelabelRows(Mat& _labels, int r1, int r2, int* _lookUpTable, int& _regionNum, Mat& _dst)
+{
+	for (int i = r1; i < r2; i++)
+	{
+		const int* ptrSp = _labels.ptr<int>(i);
+		T* ptrFix = _dst.ptr<T>(i);
+		for (int j = 0; j < _labels.cols; j++)
+		{
+			int id = _lookUpTable[ptrSp[j]];
+			if (id < 0)
+				id = _lookUpTable[ptrSp[j]] = _regionNum++;
+			ptrFix[j] = (T)id;
+		}
+	}
+}
+
+int Segmentor::CompactLabels(Mat& _labels, int _numThreads)
+{
+	CV_Assert(_labels.type() == CV_32SC1);
+	int h = _labels.rows, w = _labels.cols;
+	if (h*w == 0)
+		return 0;
+
+	int numStripes = _numThreads > 1 ? (_numThreads < h ? _numThreads : h) : 1;
+	vector<int> stripeMin(numStripes), stripeMax(numStripes);
+
+	// label range, so that the table can be sized by the largest label
+	#pragma omp parallel for num_threads(numStripes) if(numStripes > 1)
+	for (int s = 0; s < numStripes; s++)
+	{
+		int lo = INT_MAX, hi = INT_MIN;
+		for (int i = h*s/numStripes; i < h*(s+1)/numStripes; i++)
+		{
+			const int* ptr = _labels.ptr<int>(i);
+			for (int j = 0; j < w; j++)
+			{
+				if (ptr[j] < lo) lo = ptr[j];
+				if (ptr[j] > hi) hi = ptr[j];
+			}
+		}
+		stripeMin[s] = lo;
+		stripeMax[s] = hi;
+	}
+	int minLabel = *min_element(stripeMin.begin(), stripeMin.end());
+	int maxLabel = *max_element(stripeMax.begin(), stripeMax.end());
+	CV_Assert(minLabel >= 0);
+
+	vector<int> lookUpTable(maxLabel+1, -1);
+	int regionNum = 0;
+
+	if (numStripes == 1)
+	{
+		// single pass: number the labels as they are met and write them out
+		if (maxLabel < 65536)
+		{
+			Mat fixedSp(h, w, CV_16UC1);
+			RelabelRows<ushort>(_labels, 0, h, &lookUpTable[0], regionNum, fixedSp);
+			_labels = fixedSp;
+		}
+		else
+		{
+			RelabelRows<int>(_labels, 0, h, &lookUpTable[0], regionNum, _labels);
+			if (regionNum <= 65536)
+				_labels.convertTo(_labels, CV_16UC1);
+		}
+		return regionNum;
+	}
+
+	// phase 1: the labels of each stripe in the order they are first met
+	vector<vector<int> > firstSeen(numStripes);
+	#pragma omp parallel for num_threads(numStripes)
+	for (int s = 0; s < numStripes; s++)
+	{
+		vector<unsigned char> seen(maxLabel+1, 0);
+		for (int i = h*s/numStripes; i < h*(s+1)/numStripes; i++)
+		{
+			const int* ptr = _labels.ptr<int>(i);
+			for (int j = 0; j < w; j++)
+			{
+				if (!seen[ptr[j]])
+				{
+					seen[ptr[j]] = 1;
+					firstSeen[s].push_back(ptr[j]);
+				}
+			}
+		}
+	}
+
+	// merge in stripe order, which gives the same numbering as the serial pass
+	for (int s = 0; s < numStripes; s++)
+	{
+		for (int k = 0; k < firstSeen[s].size(); k++)
+		{
+			if (lookUpTable[firstSeen[s][k]] < 0)
+				lookUpTable[firstSeen[s][k]] = regionNum++;
+		}
+	}
+
+	// phase 2: every label is in the table now, the stripes only read it
+	Mat fixedSp;
+	if (regionNum <= 65536)
+		fixedSp.create(h, w, CV_16UC1);
+	else
+		fixedSp = _labels;
+	#pragma omp parallel for num_threads(numStripes)
+	for (int s = 0; s < numStripes; s++)
+	{
+		int unused = regionNum;
+		if (fixedSp.depth() == CV_16U)
+			RelabelRows<ushort>(_labels, h*s/numStripes, h*(s+1)/numStripes, &lookUpTable[0], unused, fixedSp);
+		else
+			RelabelRows<int>(_labels, h*s/numStripes, h*(s+1)/numStripes, &lookUpTable[0], unused, fixedSp);
+	}
+	_labels = fixedSp;
+	return regionNum;
+}
+
+// pixels whose clamped 4-neighbourhood contains another label become 255
+template<typename T>
+static inline uchar BoundaryPixel(const T* cur, const T* up, const T* dn, int j, int w)
 {
-	int w = m_Img.cols, h = m_Img.rows;
-	int label, top, bot, left, right;//, topl, topr, botl, botr;
-	Mat showImg = m_Img.clone();
-	Mat mask(m_Img.size(), CV_8UC1);
-	mask = 0;
+	T label = cur[j];
+	T left = cur[j > 0 ? j-1 : 0];
+	T right = cur[j+1 < w ? j+1 : w-1];
+	return (label != up[j] || label != dn[j] || label != left || label != right) ? 255 : 0;
+}
 
-	for (int i = 0; i < h; i++)
+#ifdef SEGMENTOR_SSE2
+// 8 pixels of a row: 0xFF where any neighbour differs
+static inline __m128i BoundaryBlock(const ushort* cur, const ushort* up, const ushort* dn)
+{
+	__m128i c = _mm_loadu_si128((const __m128i*)cur);
+	__m128i eq = _mm_and_si128(
+		_mm_and_si128(_mm_cmpeq_epi16(c, _mm_loadu_si128((const __m128i*)(cur-1))),
+					  _mm_cmpeq_epi16(c, _mm_loadu_si128((const __m128i*)(cur+1)))),
+		_mm_and_si128(_mm_cmpeq_epi16(c, _mm_loadu_si128((const __m128i*)up)),
+					  _mm_cmpeq_epi16(c, _mm_loadu_si128((const __m128i*)dn))));
+	return _mm_packs_epi16(eq, eq);
+}
+
+static inline __m128i BoundaryBlock(const int* cur, const int* up, const int* dn)
+{
+	__m128i eq[2];
+	for (int k = 0; k < 2; k++, cur += 4, up += 4, dn += 4)
 	{
-		for (int j = 0; j < w; j++)
+		__m128i c = _mm_loadu_si128((const __m128i*)cur);
+		eq[k] = _mm_and_si128(
+			_mm_and_si128(_mm_cmpeq_epi32(c, _mm_loadu_si128((const __m128i*)(cur-1))),
+						  _mm_cmpeq_epi32(c, _mm_loadu_si128((const __m128i*)(cur+1)))),
+			_mm_and_si128(_mm_cmpeq_epi32(c, _mm_loadu_si128((const __m128i*)up)),
+						  _mm_cmpeq_epi32(c, _mm_loadu_si128((const __m128i*)dn))));
+	}
+	__m128i eq16 = _mm_packs_epi32(eq[0], eq[1]);
+	return _mm_packs_epi16(eq16, eq16);
+}
+#endif
+
+template<typename T>
+static void BoundaryRows(const Mat& _labels, int r1, int r2, Mat& _mask)
+{
+	int w = _labels.cols, h = _labels.rows;
+	for (int i = r1; i < r2; i++)
+	{
+		const T* cur = _labels.ptr<T>(i);
+		const T* up = _labels.ptr<T>(i > 0 ? i-1 : 0);
+		const T* dn = _labels.ptr<T>(i+1 < h ? i+1 : h-1);
+		uchar* out = _mask.ptr<uchar>(i);
+
+		int j = 0;
+		out[j] = BoundaryPixel(cur, up, dn, j, w);
+		j++;
+#ifdef SEGMENTOR_SSE2
+		// interior pixels, so that the loads at j-1 and j+8 stay in the row
+		const __m128i ones = _mm_set1_epi8(-1);
+		for ( ; j+8 < w; j += 8)
 		{
-			label = m_Result.at<int>(i, j);
-			top = m_Result.at<int>( (i-1 > -1 ? i-1 : 0), j );
-			bot = m_Result.at<int>( (i+1 < h ? i+1 : h-1), j );
-			left = m_Result.at<int>( i, (j-1>-1 ? j-1 : 0) );
-			right = m_Result.at<int>( i, (j+1<w ? j+1 : w-1) );
-			if (label!=top || label!=left || label!=right || label!=bot)
-				mask.at<uchar>(i, j) = 255;
+			__m128i eq = BoundaryBlock(cur+j, up+j, dn+j);
+			_mm_storel_epi64((__m128i*)(out+j), _mm_xor_si128(eq, ones));
 		}
+#endif
+		for ( ; j < w; j++)
+			out[j] = BoundaryPixel(cur, up, dn, j, w);
+	}
+}
+
+void Segmentor::BoundaryMask(const Mat& _labels, Mat& _mask, int _numThreads)
+{
+	CV_Assert(_labels.type() == CV_16UC1 || _labels.type() == CV_32SC1);
+	int h = _labels.rows;
+	_mask.create(_labels.size(), CV_8UC1);
+	if (h == 0 || _labels.cols == 0)
+		return;
+
+	int numStripes = _numThreads > 1 ? (_numThreads < h ? _numThreads : h) : 1;
+	#pragma omp parallel for num_threads(numStripes) if(numStripes > 1)
+	for (int s = 0; s < numStripes; s++)
+	{
+		if (_labels.depth() == CV_16U)
+			BoundaryRows<ushort>(_labels, h*s/numStripes, h*(s+1)/numStripes, _mask);
+		else
+			BoundaryRows<int>(_labels, h*s/numStripes, h*(s+1)/numStripes, _mask);
 	}
-	showImg.setTo(_color, mask);
+}
+
+void Segmentor::DrawBoundaries(const Mat& _img, const Mat& _labels, Mat& _overlay, const Vec3b& _color, int _numThreads)
+{
+	Mat mask;
+	BoundaryMask(_labels, mask, _numThreads);
+	_img.copyTo(_overlay);
+	_overlay.setTo(_color, mask);
+}
+
+void Segmentor::ShowResult(const Vec3b& _color)
+{
+	Mat showImg;
+	DrawBoundaries(m_Img, m_Result, showImg, _color, m_PostThreads);
 	int end = m_ResultName.find_last_of('.');
 	string winName = m_ResultName.substr(0, end);
 	namedWindow(winName);
@@ -54,14 +299,41 @@ void Segmentor::ShowResult(const Vec3b& _color)
 
 void Segmentor::SaveResult()
 {
+	SaveResult(m_ResultName);
+}
+
+void Segmentor::SaveResult(const string& _fileName)
+{
+	WriteResult(m_Result, ResultFileName(_fileName, m_TextOutput), m_TextOutput);
+}
+
+string Segmentor::ResultFileName(const string& _name, bool _text)
+{
+	int dot = _name.find_last_of('.');
+	int sep = _name.find_last_of("/\\");
+	if (dot == string::npos || (sep != string::npos && dot < sep))
+		dot = _name.size();
+	return _name.substr(0, dot) + (_text ? ".txt" : ".lbl");
+}
+
+void Segmentor::WriteResult(const Mat& _result, const string& _fileName, bool _text)
+{
+	if (!_text)
+	{
+		if (!LabelMapWriter::Write(_result, _fileName))
+			cout<<"--Error: Cannot write result: "<<_fileName<<endl;
+		return;
+	}
+
 	// save to txt file
-	fstream f(m_ResultName, ios::out);
-	f<<m_Result.rows<<" "<<m_Result.cols<<endl;
-	for (int i = 0; i < m_Result.rows; i++)
+	fstream f(_fileName, ios::out);
+	f<<_result.rows<<" "<<_result.cols<<endl;
+	bool narrow = _result.depth() == CV_16U;
+	for (int i = 0; i < _result.rows; i++)
 	{
-		for (int j = 0; j < m_Result.cols; j++)
+		for (int j = 0; j < _result.cols; j++)
 		{
-			f<<m_Result.at<int>(i, j)<<" ";
+			f<<(narrow ? (int)_result.at<ushort>(i, j) : _result.at<int>(i, j))<<" ";
 		}
 		f<<endl;
 	}
@@ -77,40 +349,7 @@ void Segmentor::fixResult()
 {
 // رţʹñŴ0ʼسظ(+1
 // ֤һС
-	Mat _fixedSp(m_Result.size(), CV_32SC1);
-
-	int regionNum=0;
-	int* lookUpTable = new int[m_Result.cols*m_Result.rows];	// look up table,ʼΪ-1,
-	memset(lookUpTable, -1, m_Result.cols*m_Result.rows);
-	for (int i = 0; i < m_Result.rows; i++)
-	{
-		const int* ptr = m_Result.ptr<int>(i);
-		for (int j = 0; j < m_Result.cols; j++)
-		{
-			int spId = ptr[j];
-			if (lookUpTable[spId] < 0)	// ǰIdڲұвڣұ
-			{
-				lookUpTable[spId] = regionNum;
-				regionNum ++;
-			}
-		}
-	}
-
-	for (int i = 0; i < m_Result.rows; i++)
-	{
-		const int* ptrSp = m_Result.ptr<int>(i);
-		int* ptrFix = _fixedSp.ptr<int>(i);
-		for (int j = 0; j < m_Result.cols; j++)
-		{
-			int spId = ptrSp[j];
-			if (lookUpTable[spId] >= 0)
-			{
-				ptrFix[j] = lookUpTable[spId];
-			}
-		}
-	}
-	m_Result.release();
-	m_Result = _fixedSp.clone();
+	CompactLabels(m_Result, m_PostThreads);
 }
 
 //void Segmentor::Run()
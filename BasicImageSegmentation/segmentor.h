@@ -14,6 +14,8 @@ using namespace std;
 #include "opencv2/imgproc/imgproc.hpp"
 using namespace cv;
 
+#include "FeatureCache.h"
+
 // ж̬ܵĻ
 // ο http://blog.csdn.net/freefalcon/article/details/109275
 #define DECLARE_DYNCRT_BASE(base) \
@@ -70,24 +72,70 @@ class Segmentor
 
 public:
 	Segmentor();
-	~Segmentor(void);
+	virtual ~Segmentor(void);
 
 	virtual void Run() = 0;
 	virtual void SetArgs(const vector<float> args) = 0;
 
 	//static void onMouse(int event, int x, int y, int flags, void* param);
-	virtual void SetImage(const Mat& _img);
+	// _img is shared, not copied; it must not change while the segmentor uses it.
+	// Preprocessing is taken from _cache if it was built for _img, otherwise
+	// from a private cache.
+	virtual void SetImage(const Mat& _img, FeatureCache* _cache = NULL);
 	void ShowResult(const Vec3b& _color = Vec3b(0,0,255));
+
+	// Superpixel boundaries of a CV_16UC1 or CV_32SC1 label map, without any
+	// window: a pixel is 255 in the CV_8UC1 mask when one of its 4 neighbours
+	// (clamped at the border) has another label. SSE2 and stripes of rows on
+	// _numThreads threads.
+	static void BoundaryMask(const Mat& _labels, Mat& _mask, int _numThreads = 1);
+	// _img with the boundaries painted in _color
+	static void DrawBoundaries(const Mat& _img, const Mat& _labels, Mat& _overlay,
+		const Vec3b& _color = Vec3b(0,0,255), int _numThreads = 1);
+	// Results are written as binary label maps (".lbl", see LabelMapIO.h);
+	// SetTextOutput(true) switches to the old text format (".txt") for debugging.
 	void SaveResult();
+	void SaveResult(const string& _fileName);
+	void SetTextOutput(bool _text) { m_TextOutput = _text; }
+	static void WriteResult(const Mat& _result, const string& _fileName, bool _text);
+	// _name with its extension replaced by ".txt" or ".lbl"
+	static string ResultFileName(const string& _name, bool _text);
+	const string& GetResultName() const { return m_ResultName; }
+
+	// true for segmentors that need user input through HighGUI windows
+	virtual bool IsInteractive() const { return false; }
+	// true for segmentors that take the image as decoded with
+	// IMREAD_ANYDEPTH|IMREAD_ANYCOLOR (16-bit, float, any channel count);
+	// the others need CV_8UC3, and SetImage rejects anything else
+	virtual bool AcceptsAnyImage() const { return false; }
+	// true when each result depends on the images before it (video frames),
+	// so the images must reach one instance in order; valid after SetArgs
+	virtual bool IsStreaming() const { return false; }
+	// Decodes _fileName for both kinds of segmentor: _raw with its own depth
+	// and channels for AcceptsAnyImage(), _bgr as 8-bit BGR for the others.
+	// 8-bit grey and BGRA files are converted to BGR for both, so only 16-bit,
+	// float and other multi-channel images reach SLICN. An output that is not
+	// wanted may be left empty; both are empty if the file cannot be read.
+	static void ReadImage(const string& _fileName, Mat& _bgr, Mat& _raw,
+		bool _wantBGR = true, bool _wantRaw = true);
 	
 	void fixResult();
+	// Renumbers the labels of a CV_32SC1 map to 0..n-1 in raster order of
+	// first appearance and returns n. The result is CV_16UC1 when n <= 65536,
+	// otherwise the input is relabelled in place. With _numThreads > 1 the
+	// rows are split into stripes; the numbering is the same.
+	static int CompactLabels(Mat& _labels, int _numThreads = 1);
 
 protected:
 	Mat m_Img;		// Input Image
 	string m_Name;
 	string m_ResultName;
 	int m_argNum;
+	FeatureCache* m_Cache;	// preprocessing of m_Img
+	bool m_OwnCache;
+	bool m_TextOutput;
+	int m_PostThreads;	// threads used by fixResult and ShowResult
 
 public:
-	Mat m_Result;	// Result Mask
+	Mat m_Result;	// Result Mask: CV_32SC1 during Run, then CV_16UC1 when the labels fit
 };